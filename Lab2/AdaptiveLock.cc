@@ -0,0 +1,105 @@
+// AdaptiveLock.cc
+//	Routines for a lock that only uses a Lock when contended.
+//
+//	The lock word follows the three-state futex mutex of U. Drepper's
+//	"Futexes Are Tricky": 0 is free, 1 held, 2 held with possible
+//	sleepers.  The fast path takes a free lock from 0 to 1 with a
+//	single compare-and-swap.  A thread that finds it busy sets the
+//	word to 2 with an exchange, and sleeps unless the exchange found
+//	the lock free.  Release sets the word to 0, and only wakes a
+//	sleeper if it was 2, so an uncontended lock never touches the
+//	sleeping Lock.  A sleeper announces itself (by the exchange)
+//	while holding the sleeping Lock, and a releaser needs that Lock
+//	to Signal, so a wakeup cannot fall between a sleeper's check and
+//	its Wait.
+//
+// Copyright (c) 2020 MarxYoung.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+#include "AdaptiveLock.h"
+#include "system.h"
+
+//----------------------------------------------------------------------
+// AdaptiveLock::AdaptiveLock
+//	Initialize an AdaptiveLock, FREE.
+//
+//	"debugName" is an arbitrary name, useful for debugging.
+//----------------------------------------------------------------------
+
+AdaptiveLock::AdaptiveLock(char *debugName)
+{
+    name = debugName;
+    state = 0;
+    owner = NULL;
+    lock = new Lock("AdaptiveSleepLock");
+    released = new Condition("AdaptiveReleased");
+    numAcquires = numSleeps = 0;
+}
+
+//----------------------------------------------------------------------
+// AdaptiveLock::~AdaptiveLock
+//	De-allocate an AdaptiveLock; assume no one holds or waits for it.
+//----------------------------------------------------------------------
+
+AdaptiveLock::~AdaptiveLock()
+{
+    delete lock;
+    delete released;
+}
+
+//----------------------------------------------------------------------
+// AdaptiveLock::isHeldByCurrentThread
+//	True if the current thread holds the lock.
+//----------------------------------------------------------------------
+
+bool
+AdaptiveLock::isHeldByCurrentThread()
+{
+    return owner == currentThread;
+}
+
+//----------------------------------------------------------------------
+// AdaptiveLock::Acquire
+//	Take the lock if it is free; otherwise sleep until it is
+//	released.
+//----------------------------------------------------------------------
+
+void
+AdaptiveLock::Acquire()
+{
+    int expected = 0;
+
+    ASSERT(!isHeldByCurrentThread());
+    if (__atomic_compare_exchange_n(&state, &expected, 1, FALSE,
+				    __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+	owner = currentThread;		// not contended
+    } else {
+	lock->Acquire();
+	while (__atomic_exchange_n(&state, 2, __ATOMIC_ACQUIRE) != 0) {
+	    numSleeps++;
+	    released->Wait(lock);
+	}
+	lock->Release();
+	owner = currentThread;
+    }
+    numAcquires++;			// we hold the lock, so this is safe
+}
+
+//----------------------------------------------------------------------
+// AdaptiveLock::Release
+//	Free the lock, and wake a sleeper if there may be one.
+//----------------------------------------------------------------------
+
+void
+AdaptiveLock::Release()
+{
+    ASSERT(isHeldByCurrentThread());
+    owner = NULL;
+    if (__atomic_exchange_n(&state, 0, __ATOMIC_RELEASE) == 2) {
+	lock->Acquire();
+	released->Signal(lock);
+	lock->Release();
+    }
+}
@@ -0,0 +1,58 @@
+// AdaptiveLock.h
+//	A lock that takes the uncontended case without going through a
+//	Lock.
+//
+//	This is the three-state lock of U. Drepper's "Futexes Are Tricky":
+//	a word that is 0 when the lock is free, 1 when it is held, and 2
+//	when it is held and someone may be asleep waiting for it.  Taking
+//	a free lock, and releasing one no one waits for, are a single
+//	atomic operation each.  Only a thread that finds the lock busy
+//	goes to sleep, on a Lock and a Condition used for nothing else,
+//	as in MPMCBuffer.
+//
+//	Despite its name, it does not spin before sleeping.  Spinning only
+//	pays if the holder can run while the spinner does, and Nachos runs
+//	one thread at a time: a thread that finds the lock busy can only
+//	let the holder go on by sleeping.  Sleeping and waking up go
+//	through the sleeping Lock as well, so when holders keep the lock
+//	for long an AdaptiveLock costs rather more than a Lock does; it
+//	is meant for locks that are short-held and seldom contended.
+//
+// Copyright (c) 2020 MarxYoung.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#ifndef ADAPTIVELOCK_H
+#define ADAPTIVELOCK_H
+
+#include "copyright.h"
+#include "synch.h"
+
+class AdaptiveLock {
+  public:
+    AdaptiveLock(char *debugName);	// initialize lock to be FREE
+    ~AdaptiveLock();			// deallocate lock
+    char *getName() { return name; }	// debugging assist
+
+    void Acquire();
+    void Release();
+
+    bool isHeldByCurrentThread();	// true if the current thread
+					// holds this lock
+
+    int Acquires() { return numAcquires; }	// calls to Acquire
+    int Sleeps() { return numSleeps; }		// waits in Acquire
+
+  private:
+    char *name;
+    int state;			// 0 free, 1 held, 2 held and someone
+				// may be asleep waiting for it
+    Thread *owner;		// holder of the lock, or NULL
+
+    Lock *lock;			// only for sleeping, never for 'state'
+    Condition *released;	// waiters sleep here
+
+    int numAcquires, numSleeps;
+};
+
+#endif // ADAPTIVELOCK_H
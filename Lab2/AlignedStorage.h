@@ -0,0 +1,54 @@
+// AlignedStorage.h
+//	Uninitialized storage for one object of type T.
+//
+//	Containers that construct objects in place, such as TypedTable
+//	and StaticBoundedBuffer, need raw bytes with the size and the
+//	alignment of T.  A char array is only aligned for char, and a
+//	union with double, long and void * only for the common types, so
+//	a T with stricter alignment (a vector type, or a struct declared
+//	aligned to a cache line) would be misplaced.  AlignedStorage<T>
+//	asks the compiler for exactly T's alignment.
+//
+//	The alignment only holds if the storage itself is placed right:
+//	as a member or a local it is, but before C++17, new[] only aligns
+//	for the fundamental types, so heap arrays of over-aligned storage
+//	must be aligned by hand (see AlignedArray).
+//
+// Copyright (c) 2020 MarxYoung.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#ifndef ALIGNEDSTORAGE_H
+#define ALIGNEDSTORAGE_H
+
+#include "copyright.h"
+
+template <class T>
+struct AlignedStorage {
+#if __cplusplus >= 201103L
+    alignas(T) char bytes[sizeof(T)];
+#else
+    char bytes[sizeof(T)] __attribute__((aligned(__alignof__(T))));
+#endif
+
+    T *Object() { return (T *) bytes; }
+};
+
+//----------------------------------------------------------------------
+// AlignedArray
+//	Carve an array of 'n' objects of type S, suitably aligned, out
+//	of a new char array, returned in '*memory' for delete [].  S
+//	must not need constructing (its members are set by the caller).
+//----------------------------------------------------------------------
+
+template <class S>
+S *
+AlignedArray(int n, char **memory)
+{
+    unsigned long align = __alignof__(S);
+
+    *memory = new char[n * sizeof(S) + align - 1];
+    return (S *) (((unsigned long) *memory + align - 1) & ~(align - 1));
+}
+
+#endif // ALIGNEDSTORAGE_H
@@ -1,6 +1,10 @@
 #include "BoundedBuffer.h"
 #include "system.h"
 
+// with SetAutoGrow, grow once writers have found the buffer full this
+// many times without a reader ever finding it empty
+#define GrowAfterWaits  4
+
 
 //----------------------------------------------------------------------
 // BoundedBuffer::BoundedBuffer
@@ -9,13 +13,27 @@
 BoundedBuffer::BoundedBuffer(int max_size)
 {
     maxsize = max_size;
-    buffer = new int[max_size] ;
+    buffer = new char[max_size] ;
     in = out = 0;
     count = 0;
+    writeReserved = readReserved = 0;
+    lowWater = highWater = 1;
+    readersWaiting = writersWaiting = 0;
+    bigReaders = bigWriters = 0;
+    readWant = writeWant = maxsize + 1;     // no one waiting
+    timedReaders = timedWriters = NULL;
+    growLimit = maxsize;            // no automatic growth
+    vCallers = vLargest = 0;
+    stamps = NULL;                  // no latency tracking
+    for ( int b = 0; b < LatencyBuckets; b++ )
+        latencyHist[b] = 0;
+    latencyCount = latencyMax = 0;
+    numWaits = 0;
+    fullWaits = 0;
     lock = new Lock("bufferLock");
     WriteFull = new  Condition("WriteFull");
     ReadEmpty = new Condition("ReadEmpty");
-    
+    Unreserved = new Condition("Unreserved");
 }
 
 
@@ -25,10 +43,12 @@ BoundedBuffer::BoundedBuffer(int max_size)
 //----------------------------------------------------------------------
 BoundedBuffer::~BoundedBuffer()
 {
-    delete buffer;
+    delete [] buffer;
+    delete [] stamps;
     delete lock;
     delete WriteFull;
     delete ReadEmpty;
+    delete Unreserved;
 }
 
 
@@ -52,44 +72,60 @@ bool BoundedBuffer::IsFull()
 }
 
 
+//----------------------------------------------------------------------
+//BoundedBuffer::Count
+//	Return the number of bytes in the buffer.  Without the lock this
+//      is only a snapshot, good for statistics.
+//----------------------------------------------------------------------
+int BoundedBuffer::Count()
+{
+	return count;
+}
+
+
+//----------------------------------------------------------------------
+//BoundedBuffer::Waits
+//	Return how many times a reader or writer has had to wait.  A
+//      wait usually means a context switch, but not every switch is a
+//      wait: threads also yield, or are preempted, with data to move.
+//----------------------------------------------------------------------
+int BoundedBuffer::Waits()
+{
+	return numWaits;
+}
+
+
 //----------------------------------------------------------------------
 //BoundedBuffer::Read
 //	Read 'size' bytes from buffer and add them to '*data' .
-//      Read one character at a time into Space starting from *data 
-//      with locks and condition variables.
+//      Each time enough data is available (see SetWatermarks), take
+//      as much of it as we still need in one go (see CopyOut), then
+//      wake a writer for the whole batch rather than one per byte.
 //      'out' is the location of the first character in the current buffer
 //----------------------------------------------------------------------
 void  BoundedBuffer::Read(void *data, int size)
 {
-    int i,j;
-    int flag = 0;
-    int *s = (int *)data;
+    int j;
+    int done = 0;
+    int target;
+    char *s = (char *)data;
     lock -> Acquire();
-    for(i = 0; i < size; i++)
+    while (done < size)
     {
-        if ( IsEmpty() )
+        target = (size - done < lowWater) ? size - done : lowWater;
+        if ( count < target && DebugIsEnabled('b') )
             {
                 PrintBuffer();
                 printf("%s's data is:",currentThread -> getName());
-                for(j = 0; j < i ; j++)
-                    printf("%d ",*(s + j));
+                for(j = 0; j < done ; j++)
+                    printf("%d ",(unsigned char)*(s + j));
                 printf("\n\n");
             }
-        while( IsEmpty() )
-            {
-                ReadEmpty -> Wait(lock);
-                flag = 1;
-            }
-        if ( flag == 1 )	
-            {
-                printf("Context switch to  %s \n", currentThread -> getName());
-                flag = 0;
-            }
-        *(s + i) = *(buffer + out);
-        out = (out + 1) % maxsize;
-        count--;
-        WriteFull -> Signal(lock);
+        WaitForData(target);
+        done += CopyOut(s + done, size - done);
+        WakeWriters();
     }
+    WakeReaders();              // pass what we left on to another reader
     lock -> Release();
 }
 
@@ -97,39 +133,760 @@ void  BoundedBuffer::Read(void *data, int size)
 
 //----------------------------------------------------------------------
 //BoundedBuffer::Write
-//	Write 'size' bytes from '*data' to buffer,
-//      write one character at a time into the buffer 
-//      with locks and condition variables
+//	Write 'size' bytes from '*data' to buffer.
+//      Each time there is enough room (see SetWatermarks), fill as much
+//      of it as we can in one go (see CopyIn), then wake a reader for
+//      the whole batch.
 //       'in' is the location of the last character in the current buffer
 //----------------------------------------------------------------------
 void BoundedBuffer::Write(void *data, int size)
 {
-     int *s = (int *)data;
-     int i;
-     int flag = 0;
+     char *s = (char *)data;
+     int done = 0;
+     int target;
      lock -> Acquire();
-     for(i = 0; i < size; i++)
+     while (done < size)
     {
-        if ( IsFull() )
+        target = (size - done < highWater) ? size - done : highWater;
+        if ( maxsize - count < target && DebugIsEnabled('b') )
             {
                 PrintBuffer();
             }
-        while( IsFull() )
+        WaitForSpace(target);
+        done += CopyIn(s + done, size - done);
+        WakeReaders();
+    }
+    WakeWriters();              // pass the remaining room on to another writer
+    lock -> Release();
+}
+
+
+//----------------------------------------------------------------------
+//BoundedBuffer::TryRead
+//	Read whatever data is in the buffer right now, up to 'size'
+//      bytes, and return how many bytes were read.  Never wait for
+//      data; return 0 if there is none (or a ReadPeek is outstanding).
+//----------------------------------------------------------------------
+int BoundedBuffer::TryRead(void *data, int size)
+{
+    int done = 0;
+    lock -> Acquire();
+    if ( readReserved == 0 )
+        {
+            done = CopyOut((char *)data, size);
+            if ( done > 0 )
+                WakeWriters();
+        }
+    lock -> Release();
+    return done;
+}
+
+
+//----------------------------------------------------------------------
+//BoundedBuffer::TryWrite
+//	Write as much of 'data' as fits in the buffer right now, and
+//      return how many bytes were written.  Never wait for room.
+//----------------------------------------------------------------------
+int BoundedBuffer::TryWrite(void *data, int size)
+{
+    int done = 0;
+    lock -> Acquire();
+    if ( writeReserved == 0 )
+        {
+            done = CopyIn((char *)data, size);
+            if ( done > 0 )
+                WakeReaders();
+        }
+    lock -> Release();
+    return done;
+}
+
+
+//----------------------------------------------------------------------
+//BoundedBuffer::ReadSome
+//	Wait until there is some data, then read as much of it as there
+//      is, up to 'size' bytes, and return how many bytes were read.
+//      Unlike Read, this does not hold on to the buffer while waiting
+//      for the rest of 'size', so other readers get their turn.
+//----------------------------------------------------------------------
+int BoundedBuffer::ReadSome(void *data, int size)
+{
+    int done;
+    if ( size <= 0 )
+        return 0;
+    lock -> Acquire();
+    WaitForData(1);
+    done = CopyOut((char *)data, size);
+    WakeWriters();
+    WakeReaders();              // pass what we left on to another reader
+    lock -> Release();
+    return done;
+}
+
+
+//----------------------------------------------------------------------
+//BoundedBuffer::WriteSome
+//	Wait until there is some room, then write as much of 'data' as
+//      fits, up to 'size' bytes, and return how many bytes were written.
+//----------------------------------------------------------------------
+int BoundedBuffer::WriteSome(void *data, int size)
+{
+    int done;
+    if ( size <= 0 )
+        return 0;
+    lock -> Acquire();
+    WaitForSpace(1);
+    done = CopyIn((char *)data, size);
+    WakeReaders();
+    WakeWriters();              // pass the remaining room on to another writer
+    lock -> Release();
+    return done;
+}
+
+
+//----------------------------------------------------------------------
+//BoundedBuffer::ReadTimeout
+//	Like Read, but give up waiting once 'ticks' ticks have passed.
+//      Return the number of bytes read, which is less than 'size' only
+//      if we gave up.  In Lab3 the wait is cut short by the Alarm; in
+//      Lab2, which has none, the thread polls instead.
+//----------------------------------------------------------------------
+int BoundedBuffer::ReadTimeout(void *data, int size, int ticks)
+{
+    int done = 0;
+    int target;
+    int deadline = stats -> totalTicks + ticks;
+    char *s = (char *)data;
+    lock -> Acquire();
+    while (done < size)
+    {
+        target = (size - done < lowWater) ? size - done : lowWater;
+        if ( !WaitForData(target, deadline) )
             {
-                WriteFull -> Wait(lock);
-                flag = 1;
+                DEBUG('b', "%s timed out in Read\n", currentThread -> getName());
+                break;
             }
-        if ( flag == 1 )	
+        done += CopyOut(s + done, size - done);
+        WakeWriters();
+    }
+    WakeReaders();
+    lock -> Release();
+    return done;
+}
+
+
+//----------------------------------------------------------------------
+//BoundedBuffer::WriteTimeout
+//	Like Write, but give up waiting once 'ticks' ticks have passed.
+//      Return the number of bytes written.
+//----------------------------------------------------------------------
+int BoundedBuffer::WriteTimeout(void *data, int size, int ticks)
+{
+    int done = 0;
+    int target;
+    int deadline = stats -> totalTicks + ticks;
+    char *s = (char *)data;
+    lock -> Acquire();
+    while (done < size)
+    {
+        target = (size - done < highWater) ? size - done : highWater;
+        if ( !WaitForSpace(target, deadline) )
             {
-                printf("Context switch to  %s \n", currentThread -> getName());
-                flag = 0;
+                DEBUG('b', "%s timed out in Write\n", currentThread -> getName());
+                break;
             }
-        *(buffer + in) = *(s + i);
-        in = (in + 1) % maxsize;
-        count++;
-        ReadEmpty -> Signal(lock);
+        done += CopyIn(s + done, size - done);
+        WakeReaders();
     }
+    WakeWriters();
+    lock -> Release();
+    return done;
+}
+
+
+//----------------------------------------------------------------------
+//BoundedBuffer::WriteV
+//	Write the 'nvec' pieces described by 'vec' as one message: wait
+//      until there is room for all of it, then copy the pieces in one
+//      after the other without letting go of the lock.  The message
+//      thus lands contiguously in the ring, not interleaved with any
+//      other writer's data, and costs one acquisition and one wakeup.
+//      The message must fit in the buffer.
+//----------------------------------------------------------------------
+void BoundedBuffer::WriteV(BufferSpan *vec, int nvec)
+{
+    int total = 0;
+    int i;
+    for ( i = 0; i < nvec; i++ )
+        total += vec[i].size;
+    lock -> Acquire();
+    ASSERT(total <= maxsize);
+    BeginV(total);
+    WaitForSpace(total);
+    for ( i = 0; i < nvec; i++ )
+        CopyIn(vec[i].data, vec[i].size);
+    EndV();
+    WakeReaders();
+    WakeWriters();
+    lock -> Release();
+}
+
+
+//----------------------------------------------------------------------
+//BoundedBuffer::ReadV
+//	Fill the 'nvec' pieces described by 'vec', in order: wait until
+//      there are as many bytes in the buffer as the pieces hold in all,
+//      then copy them out in one go, so no other reader can take part
+//      of them.  The buffer keeps no message boundaries, so these are
+//      simply the next bytes, whichever writes they came from; to get
+//      back what one WriteV wrote, ask for the same total size.
+//      The total must fit in the buffer.
+//----------------------------------------------------------------------
+void BoundedBuffer::ReadV(BufferSpan *vec, int nvec)
+{
+    int total = 0;
+    int i;
+    for ( i = 0; i < nvec; i++ )
+        total += vec[i].size;
+    lock -> Acquire();
+    ASSERT(total <= maxsize);
+    BeginV(total);
+    WaitForData(total);
+    for ( i = 0; i < nvec; i++ )
+        CopyOut(vec[i].data, vec[i].size);
+    EndV();
+    WakeWriters();
+    WakeReaders();
+    lock -> Release();
+}
+
+
+//----------------------------------------------------------------------
+//BoundedBuffer::BeginV, BoundedBuffer::EndV
+//	Keep track of the largest total of any ReadV or WriteV in
+//      progress, so that Resize does not shrink the buffer below it.
+//      Like 'readWant', 'vLargest' is only reset once no V call is in
+//      progress, so it may be too big, which only makes Resize keep
+//      more room than it had to.
+//      The caller must hold the lock.
+//----------------------------------------------------------------------
+void BoundedBuffer::BeginV(int total)
+{
+    vCallers++;
+    if ( total > vLargest )
+        vLargest = total;
+}
+
+void BoundedBuffer::EndV()
+{
+    if ( --vCallers == 0 )
+        vLargest = 0;
+}
+
+
+//----------------------------------------------------------------------
+//BoundedBuffer::WriteReserve
+//	Wait until there is free space and no other reservation, then
+//      reserve up to 'size' bytes of it for the caller to fill in place.
+//      The reserved space is described by 'span' (the part before the
+//      wrap point, then the part after it).  Return its size.
+//      The lock is not held while the caller fills the space; readers
+//      cannot see it, and other writers wait, until WriteCommit.
+//----------------------------------------------------------------------
+int BoundedBuffer::WriteReserve(int size, BufferSpan span[2])
+{
+    ASSERT(size > 0);
+    lock -> Acquire();
+    WaitForSpace(1);
+    writeReserved = Spans(in, maxsize - count, size, span);
+    lock -> Release();
+    return writeReserved;
+}
+
+
+//----------------------------------------------------------------------
+//BoundedBuffer::WriteCommit
+//	Publish the first 'size' bytes of the space handed out by
+//      WriteReserve, and end the reservation.
+//----------------------------------------------------------------------
+void BoundedBuffer::WriteCommit(int size)
+{
+    lock -> Acquire();
+    ASSERT(writeReserved > 0 && size >= 0 && size <= writeReserved);
+    if ( stamps != NULL )
+        StampIn(in, size);
+    in = (in + size) % maxsize;
+    count += size;
+    writeReserved = 0;
+    WakeReaders();
+    WakeAllWriters();               // let the next writer in
+    Unreserved -> Broadcast(lock);
+    lock -> Release();
+}
+
+
+//----------------------------------------------------------------------
+//BoundedBuffer::ReadPeek
+//	Wait until there is data and no other peek, then describe up to
+//      'size' bytes of it in 'span' and return how many.  The bytes
+//      remain in the buffer, and other readers wait, until ReadConsume.
+//----------------------------------------------------------------------
+int BoundedBuffer::ReadPeek(int size, BufferSpan span[2])
+{
+    ASSERT(size > 0);
+    lock -> Acquire();
+    WaitForData(1);
+    readReserved = Spans(out, count, size, span);
+    lock -> Release();
+    return readReserved;
+}
+
+
+//----------------------------------------------------------------------
+//BoundedBuffer::ReadConsume
+//	Remove the first 'size' bytes of the data handed out by ReadPeek
+//      from the buffer, and end the peek.
+//----------------------------------------------------------------------
+void BoundedBuffer::ReadConsume(int size)
+{
+    lock -> Acquire();
+    ASSERT(readReserved > 0 && size >= 0 && size <= readReserved);
+    if ( stamps != NULL )
+        StampOut(out, size);
+    out = (out + size) % maxsize;
+    count -= size;
+    readReserved = 0;
+    WakeWriters();
+    WakeAllReaders();               // let the next reader in
+    Unreserved -> Broadcast(lock);
+    lock -> Release();
+}
+
+
+//----------------------------------------------------------------------
+//BoundedBuffer::SetWatermarks
+//	Set how much data must be available before a waiting reader is
+//      woken ('low'), and how much room before a waiting writer is
+//      ('high').  A thread that needs less than that is woken as soon
+//      as what it needs is there.  Larger watermarks mean fewer, larger
+//      transfers and fewer waits.  The default of 1 and 1 wakes
+//      threads as soon as they can make any progress.
+//
+//      A reader waits while fewer than 'low' bytes are in the buffer and
+//      a writer while fewer than 'high' bytes are free.  If low + high
+//      were more than maxsize + 1, both could wait at once, forever.
+//      That only holds for the watermarks, though: a ReadV or WriteV
+//      waits for its whole total, however big.  So while one of them
+//      is waiting, threads on the other side give up their watermark
+//      and move whatever they can, which fills (empties) the buffer
+//      far enough for it.  A ReadV and a WriteV can still wait for
+//      each other if no one else uses the buffer.
+//----------------------------------------------------------------------
+void BoundedBuffer::SetWatermarks(int low, int high)
+{
+    ASSERT(low >= 1 && high >= 1 && low + high <= maxsize + 1);
+    lock -> Acquire();
+    lowWater = low;
+    highWater = high;
+    WakeAllReaders();               // waiters re-evaluate their targets
+    WakeAllWriters();
+    lock -> Release();
+}
+
+
+//----------------------------------------------------------------------
+//BoundedBuffer::Resize
+//	Change the capacity to 'newMax' bytes while the buffer is in use,
+//      keeping the data in it, and return the new capacity.  We cannot
+//      move the ring while a WriteReserve or ReadPeek is outstanding,
+//      so wait for those to finish.  We never drop data, break the
+//      watermarks, or go below the total of a WriteV or ReadV in
+//      progress, which could then never be met; so a shrink may stop
+//      short of 'newMax'.
+//----------------------------------------------------------------------
+int BoundedBuffer::Resize(int newMax)
+{
+    int size;
+    ASSERT(newMax > 0);
+    lock -> Acquire();
+    while( writeReserved > 0 || readReserved > 0 )
+        Unreserved -> Wait(lock);
+    if ( newMax < count )
+        newMax = count;
+    if ( newMax < lowWater + highWater - 1 )
+        newMax = lowWater + highWater - 1;
+    if ( newMax < vLargest )
+        newMax = vLargest;
+    Reallocate(newMax);
+    size = maxsize;
+    lock -> Release();
+    return size;
+}
+
+
+//----------------------------------------------------------------------
+//BoundedBuffer::SetAutoGrow
+//	Let the buffer double in size, up to 'limit' bytes, whenever
+//      writers keep finding it full: that is, when they have had to
+//      wait GrowAfterWaits times and readers never found it empty in
+//      between.  A 'limit' no larger than the current size turns this
+//      off.
+//----------------------------------------------------------------------
+void BoundedBuffer::SetAutoGrow(int limit)
+{
+    lock -> Acquire();
+    growLimit = limit;
+    fullWaits = 0;
+    lock -> Release();
+}
+
+
+//----------------------------------------------------------------------
+//BoundedBuffer::Reallocate
+//	Move the data into a new ring of 'newMax' bytes, starting at its
+//      beginning, and wake anyone who may now go ahead.  There must be
+//      room for all the data, and no reservation outstanding.
+//      The caller must hold the lock.
+//----------------------------------------------------------------------
+void BoundedBuffer::Reallocate(int newMax)
+{
+    BufferSpan span[2];
+    char *old = buffer;
+
+    ASSERT(newMax >= count && writeReserved == 0 && readReserved == 0);
+    DEBUG('b', "Resizing buffer from %d to %d bytes\n", maxsize, newMax);
+    Spans(out, count, count, span);     // the data, in the old ring
+    buffer = new char[newMax];
+    memcpy(buffer, span[0].data, span[0].size);
+    memcpy(buffer + span[0].size, span[1].data, span[1].size);
+    delete [] old;
+    if ( stamps != NULL )
+        {
+            int *oldStamps = stamps;
+            stamps = new int[newMax];
+            for ( int i = 0; i < count; i++ )
+                stamps[i] = oldStamps[(out + i) % maxsize];
+            delete [] oldStamps;
+        }
+    maxsize = newMax;
+    out = 0;
+    in = count % maxsize;
+    if ( readersWaiting == 0 )      // keep "no one waiting" out of reach
+        readWant = maxsize + 1;
+    if ( writersWaiting == 0 )
+        writeWant = maxsize + 1;
+    WakeAllWriters();
+    WakeReaders();
+}
+
+
+//----------------------------------------------------------------------
+//BoundedBuffer::WaitForData
+//	Wait until at least 'target' bytes are in the buffer and there
+//      is no outstanding ReadPeek.  Record the smallest target of any
+//      waiting reader in 'readWant', so that writers know when one of
+//      them can proceed even below the low watermark.  'readWant' is
+//      only reset once no reader is waiting, so it may be too small,
+//      which costs a wasted wakeup but never a missed one.
+//
+//      A reader in ReadV needs its whole 'target', however big, while
+//      other readers only wait for the low watermark.  If a WriteV is
+//      waiting for more room than a reader at the watermark would
+//      leave it, such a reader takes whatever data there is instead
+//      (see SetWatermarks); and a reader in ReadV that has to wait
+//      wakes the writers, so that they do the same for it.
+//
+//      If 'deadline' is not -1, give up once stats->totalTicks reaches
+//      it; return FALSE if we gave up, TRUE if the data is there.
+//      The caller must hold the lock.
+//----------------------------------------------------------------------
+bool BoundedBuffer::WaitForData(int target, int deadline)
+{
+    bool expired = FALSE;
+    bool big = target > lowWater;
+    while( count < ((bigWriters > 0 && !big) ? 1 : target)
+           || readReserved > 0 )
+        {
+            if ( expired )
+                return FALSE;
+            fullWaits = 0;          // readers are keeping up
+            if ( target < readWant )
+                readWant = target;
+            readersWaiting++;
+            numWaits++;
+            if ( big )
+                {
+                    bigReaders++;
+                    WakeWriters();  // they may stop at the watermark
+                }
+            if ( deadline == -1 )
+                ReadEmpty -> Wait(lock);
+            else
+                expired = TimedWait(&timedReaders, deadline);
+            if ( big )
+                bigReaders--;
+            if ( --readersWaiting == 0 )
+                readWant = maxsize + 1;
+            DEBUG('b', "Context switch to  %s \n", currentThread -> getName());
+        }
+    return TRUE;
+}
+
+
+//----------------------------------------------------------------------
+//BoundedBuffer::WaitForSpace
+//	Wait until at least 'target' bytes are free and there is no
+//      outstanding WriteReserve.  'writeWant' is kept like 'readWant',
+//      and a writer at the high watermark makes way for a reader in
+//      ReadV as a reader does for WriteV (see WaitForData).
+//      If the buffer may grow (see SetAutoGrow) and writers keep finding
+//      it full, grow it rather than wait.
+//      The caller must hold the lock.
+//----------------------------------------------------------------------
+bool BoundedBuffer::WaitForSpace(int target, int deadline)
+{
+    bool expired = FALSE;
+    bool big = target > highWater;
+    while( maxsize - count < ((bigReaders > 0 && !big) ? 1 : target)
+           || writeReserved > 0 )
+        {
+            if ( expired )
+                return FALSE;
+            if ( maxsize < growLimit && writeReserved == 0
+                 && readReserved == 0 && ++fullWaits >= GrowAfterWaits )
+                {
+                    fullWaits = 0;
+                    Reallocate(2 * maxsize < growLimit ? 2 * maxsize
+                                                       : growLimit);
+                    continue;
+                }
+            if ( target < writeWant )
+                writeWant = target;
+            writersWaiting++;
+            numWaits++;
+            if ( big )
+                {
+                    bigWriters++;
+                    WakeReaders();  // they may stop at the watermark
+                }
+            if ( deadline == -1 )
+                WriteFull -> Wait(lock);
+            else
+                expired = TimedWait(&timedWriters, deadline);
+            if ( big )
+                bigWriters--;
+            if ( --writersWaiting == 0 )
+                writeWant = maxsize + 1;
+            DEBUG('b', "Context switch to  %s \n", currentThread -> getName());
+        }
+    return TRUE;
+}
+
+
+//----------------------------------------------------------------------
+//BoundedBuffer::WakeReaders
+//	Wake readers if the data in the buffer lets one proceed.  At the
+//      low watermark every reader can, so one Signal will do; below it,
+//      only those with smaller needs can, and we do not know which of
+//      the waiters they are, so wake them all.  The same goes when
+//      someone in ReadV needs more than the watermark, since a Signal
+//      might go to it and be wasted, and when someone in WriteV is
+//      waiting, since then any data at all lets a reader go ahead.
+//      Threads in a timed wait are not on the condition; wake them all
+//      whenever anyone is woken, and let them check for themselves.
+//      The caller must hold the lock.
+//----------------------------------------------------------------------
+void BoundedBuffer::WakeReaders()
+{
+    if ( count >= lowWater && bigReaders > 0 )
+        WakeAllReaders();
+    else if ( count >= lowWater )
+        {
+            ReadEmpty -> Signal(lock);
+            WakeTimed(timedReaders);
+        }
+    else if ( count >= readWant || (bigWriters > 0 && count > 0) )
+        WakeAllReaders();
+}
+
+
+//----------------------------------------------------------------------
+//BoundedBuffer::WakeWriters
+//	Wake writers if the free space lets one proceed, as WakeReaders
+//      does for readers.
+//      The caller must hold the lock.
+//----------------------------------------------------------------------
+void BoundedBuffer::WakeWriters()
+{
+    if ( maxsize - count >= highWater && bigWriters > 0 )
+        WakeAllWriters();
+    else if ( maxsize - count >= highWater )
+        {
+            WriteFull -> Signal(lock);
+            WakeTimed(timedWriters);
+        }
+    else if ( maxsize - count >= writeWant
+              || (bigReaders > 0 && maxsize - count > 0) )
+        WakeAllWriters();
+}
+
+
+//----------------------------------------------------------------------
+//BoundedBuffer::WakeAllReaders
+//	Wake every waiting reader, timed or not.
+//      The caller must hold the lock.
+//----------------------------------------------------------------------
+void BoundedBuffer::WakeAllReaders()
+{
+    ReadEmpty -> Broadcast(lock);
+    WakeTimed(timedReaders);
+}
+
+
+//----------------------------------------------------------------------
+//BoundedBuffer::WakeAllWriters
+//	Wake every waiting writer, timed or not.
+//      The caller must hold the lock.
+//----------------------------------------------------------------------
+void BoundedBuffer::WakeAllWriters()
+{
+    WriteFull -> Broadcast(lock);
+    WakeTimed(timedWriters);
+}
+
+
+//----------------------------------------------------------------------
+//BoundedBuffer::TimedWait
+//	Release the lock and sleep until woken (see WakeTimed) or until
+//      'deadline', whichever comes first, then re-acquire the lock.
+//      Return TRUE if the deadline has passed.
+//
+//      A condition variable cannot be signalled from the timer interrupt,
+//      since that would need the lock, so each timed waiter sleeps on a
+//      semaphore of its own, which both the timer and other threads can
+//      V.  Because a semaphore remembers a V, a wakeup that comes after
+//      we release the lock but before we sleep is not lost.  The waiter
+//      stays on 'queue' until it has the lock again, so it may be V'ed
+//      more than once; the extra counts die with the semaphore.
+//
+//      Builds with the Lab3 Alarm define HAVE_ALARM (see its
+//      Makefile.common).  Without it there is no timer to wake us, so
+//      just give up the CPU and look again.
+//      The caller must hold the lock.
+//----------------------------------------------------------------------
+#ifdef HAVE_ALARM
+static void TimedWaitExpired(int arg)
+{
+    ((Semaphore *)arg) -> V();
+}
+#endif
+
+bool BoundedBuffer::TimedWait(TimedWaiter **queue, int deadline)
+{
+    int left = deadline - stats -> totalTicks;
+    if ( left <= 0 )
+        return TRUE;
+#ifdef HAVE_ALARM
+    Semaphore wakeup("timedWait", 0);
+    TimedWaiter self;
+    TimedWaiter **p;
+    int timeout;
+
+    self.wakeup = &wakeup;
+    self.next = *queue;
+    *queue = &self;
+    timeout = alarms -> SetTimeout(left, TimedWaitExpired, (int)&wakeup);
+    lock -> Release();
+    wakeup.P();
+    alarms -> CancelTimeout(timeout);
+    lock -> Acquire();
+    for ( p = queue; *p != &self; p = &(*p) -> next )
+        ;
+    *p = self.next;
+#else
     lock -> Release();
+    currentThread -> Yield();
+    lock -> Acquire();
+#endif
+    return stats -> totalTicks >= deadline;
+}
+
+
+//----------------------------------------------------------------------
+//BoundedBuffer::WakeTimed
+//	Wake every thread in a timed wait on 'queue'.
+//      The caller must hold the lock.
+//----------------------------------------------------------------------
+void BoundedBuffer::WakeTimed(TimedWaiter *queue)
+{
+    for ( ; queue != NULL; queue = queue -> next )
+        queue -> wakeup -> V();
+}
+
+
+//----------------------------------------------------------------------
+//BoundedBuffer::Spans
+//	Describe up to 'size' of the 'avail' contiguous (modulo maxsize)
+//      bytes starting at offset 'start' as two spans: up to the end of
+//      the buffer, then from its beginning.  Return the total size.
+//----------------------------------------------------------------------
+int BoundedBuffer::Spans(int start, int avail, int size, BufferSpan span[2])
+{
+    int total = (size < avail) ? size : avail;
+    int first = maxsize - start;                // up to the end of buffer
+
+    if (first > total)
+        first = total;
+    span[0].data = buffer + start;
+    span[0].size = first;
+    span[1].data = buffer;
+    span[1].size = total - first;
+    return total;
+}
+
+
+//----------------------------------------------------------------------
+//BoundedBuffer::CopyOut
+//	Move up to 'size' bytes from the buffer to 'data', as many as
+//      are available, and return how many were moved.  The bytes are
+//      contiguous in the buffer except where they wrap around its end,
+//      so this takes at most two memcpy calls.
+//      The caller must hold the lock.
+//----------------------------------------------------------------------
+int BoundedBuffer::CopyOut(char *data, int size)
+{
+    BufferSpan span[2];
+    int total = Spans(out, count, size, span);
+
+    memcpy(data, span[0].data, span[0].size);
+    memcpy(data + span[0].size, span[1].data, span[1].size);
+    if ( stamps != NULL )
+        StampOut(out, total);
+    out = (out + total) % maxsize;
+    count -= total;
+    return total;
+}
+
+
+//----------------------------------------------------------------------
+//BoundedBuffer::CopyIn
+//	Move up to 'size' bytes from 'data' into the buffer, as many as
+//      there is room for, and return how many were moved.  At most two
+//      memcpy calls, one on either side of the wrap point.
+//      The caller must hold the lock.
+//----------------------------------------------------------------------
+int BoundedBuffer::CopyIn(char *data, int size)
+{
+    BufferSpan span[2];
+    int total = Spans(in, maxsize - count, size, span);
+
+    memcpy(span[0].data, data, span[0].size);
+    memcpy(span[1].data, data + span[0].size, span[1].size);
+    if ( stamps != NULL )
+        StampIn(in, total);
+    in = (in + total) % maxsize;
+    count += total;
+    return total;
 }
 
 
@@ -146,10 +903,135 @@ void BoundedBuffer::PrintBuffer()
     printf("Current buffer is :");
     while(num--)
     {
-        printf("%d ", *(buffer+i));
+        printf("%d ", (unsigned char)*(buffer+i));
         i = (i + 1) % maxsize;
     }
-    printf("\n\n");
+    printf("\n");
+    if ( stamps != NULL )
+        PrintLatency();
+    printf("\n");
+}
+
+
+//----------------------------------------------------------------------
+//BoundedBuffer::TrackLatency
+//	Start or stop recording how long each byte stays in the buffer,
+//      from the tick it is written to the tick it is read.  Starting
+//      clears the statistics; bytes already in the buffer count as
+//      written now.  This costs a word per byte of buffer, and a pass
+//      over every byte moved, so it is off by default.
+//----------------------------------------------------------------------
+void BoundedBuffer::TrackLatency(bool on)
+{
+    lock -> Acquire();
+    delete [] stamps;
+    stamps = NULL;
+    if ( on )
+        {
+            stamps = new int[maxsize];
+            for ( int i = 0; i < maxsize; i++ )
+                stamps[i] = stats -> totalTicks;
+            for ( int b = 0; b < LatencyBuckets; b++ )
+                latencyHist[b] = 0;
+            latencyCount = latencyMax = 0;
+        }
+    lock -> Release();
+}
+
+
+//----------------------------------------------------------------------
+//BoundedBuffer::StampIn
+//	Record the current tick for the 'size' bytes written at 'start'.
+//      The caller must hold the lock.
+//----------------------------------------------------------------------
+void BoundedBuffer::StampIn(int start, int size)
+{
+    int now = stats -> totalTicks;
+    for ( int i = start; size > 0; size-- )
+        {
+            stamps[i] = now;
+            if ( ++i == maxsize )
+                i = 0;
+        }
+}
+
+
+//----------------------------------------------------------------------
+//BoundedBuffer::StampOut
+//	Add the time the 'size' bytes read at 'start' spent in the buffer
+//      to the histogram.  Bucket 0 counts bytes read in the tick they
+//      were written; bucket b > 0 counts those that waited from 2^(b-1)
+//      up to 2^b - 1 ticks.
+//      The caller must hold the lock.
+//----------------------------------------------------------------------
+void BoundedBuffer::StampOut(int start, int size)
+{
+    int now = stats -> totalTicks;
+    for ( int i = start; size > 0; size-- )
+        {
+            int latency = now - stamps[i];
+            int b = 0;
+            while ( (latency >> b) > 0 && b < LatencyBuckets - 1 )
+                b++;
+            latencyHist[b]++;
+            latencyCount++;
+            if ( latency > latencyMax )
+                latencyMax = latency;
+            if ( ++i == maxsize )
+                i = 0;
+        }
+}
+
+
+//----------------------------------------------------------------------
+//BoundedBuffer::LatencyCount
+//	Return how many bytes were read since latency tracking started.
+//----------------------------------------------------------------------
+int BoundedBuffer::LatencyCount()
+{
+    return latencyCount;
+}
+
+
+//----------------------------------------------------------------------
+//BoundedBuffer::LatencyPercentile
+//	Return an upper bound on the latency of the first 'percent' per
+//      cent of the bytes read: the top of the bucket where they end.
+//----------------------------------------------------------------------
+int BoundedBuffer::LatencyPercentile(int percent)
+{
+    int wanted = (latencyCount * percent + 99) / 100;
+    int seen = 0;
+    for ( int b = 0; b < LatencyBuckets; b++ )
+        {
+            seen += latencyHist[b];
+            if ( seen >= wanted && b == 0 )
+                return 0;
+            if ( seen >= wanted )
+                return ((1 << b) - 1 < latencyMax) ? (1 << b) - 1 : latencyMax;
+        }
+    return latencyMax;
+}
+
+
+//----------------------------------------------------------------------
+//BoundedBuffer::PrintLatency
+//	Print the latency histogram and its p50, p99 and maximum.
+//----------------------------------------------------------------------
+void BoundedBuffer::PrintLatency()
+{
+    if ( latencyCount == 0 )
+        {
+            printf("No bytes read since latency tracking started\n");
+            return;
+        }
+    printf("Latency of %d bytes: p50 <= %d, p99 <= %d, max %d ticks\n",
+           latencyCount, LatencyPercentile(50), LatencyPercentile(99),
+           latencyMax);
+    for ( int b = 0; b < LatencyBuckets; b++ )
+        if ( latencyHist[b] > 0 )
+            printf("  %10d - %10d ticks: %d\n", (b == 0) ? 0 : 1 << (b - 1),
+                   (b == 0) ? 0 : (1 << b) - 1, latencyHist[b]);
 }
 
 
@@ -1,5 +1,19 @@
+#ifndef BOUNDEDBUFFER_H
+#define BOUNDEDBUFFER_H
+
 #include "synch.h"
 
+// A run of contiguous bytes inside a BoundedBuffer.  Free space or
+// data in the ring may wrap around its end, so the zero-copy calls
+// below describe it with two of these; the second may be empty.
+// WriteV and ReadV take an array of them, one per user buffer.
+struct BufferSpan {
+     char *data;
+     int size;
+};
+
+#define LatencyBuckets  32      // see BoundedBuffer::StampOut
+
 class BoundedBuffer {
    public:
      // create a bounded buffer with a limit of 'maxsize' bytes
@@ -17,23 +31,149 @@ class BoundedBuffer {
      // ('size' may be greater than 'maxsize')
      void Write(void *data, int size);
 
+     // move whatever can be moved right now, up to 'size' bytes, without
+     // waiting.  Return the number of bytes read (written), maybe 0.
+     int TryRead(void *data, int size);
+     int TryWrite(void *data, int size);
+
+     // wait only until some bytes can be moved, then move as many as
+     // possible, up to 'size'.  Return the number of bytes moved.
+     int ReadSome(void *data, int size);
+     int WriteSome(void *data, int size);
+
+     // gather the 'nvec' pieces in 'vec' and write them as a unit, or
+     // read as many bytes as the pieces hold in all, as a unit, and
+     // scatter them into the pieces.  There is no framing: ReadV takes
+     // the next bytes, not one WriteV's worth.  The total must fit in
+     // the buffer.
+     void WriteV(BufferSpan *vec, int nvec);
+     void ReadV(BufferSpan *vec, int nvec);
+
+     // like Read and Write, but give up waiting after 'ticks' ticks.
+     // Return the number of bytes moved, less than 'size' on timeout.
+     int ReadTimeout(void *data, int size, int ticks);
+     int WriteTimeout(void *data, int size, int ticks);
+
+     // zero-copy writing: wait until there is room, then reserve up
+     // to 'size' free bytes and describe them in span[0..1].  Return
+     // the number of bytes reserved.  The caller fills them in place,
+     // then calls WriteCommit with the number it actually wrote.
+     // Only one reservation may be outstanding at a time.
+     int WriteReserve(int size, BufferSpan span[2]);
+     void WriteCommit(int size);
+
+     // zero-copy reading: wait until there is data, then describe up to
+     // 'size' bytes of it in span[0..1] and return how many.  The data
+     // stays in the buffer until ReadConsume removes the first 'size'
+     // bytes.  Only one peek may be outstanding at a time.
+     int ReadPeek(int size, BufferSpan span[2]);
+     void ReadConsume(int size);
+
+     // wake waiting readers only once 'low' bytes are available, and
+     // waiting writers only once 'high' bytes are free (or once what
+     // they still need is, if that is less).  Both default to 1.
+     void SetWatermarks(int low, int high);
+
+     // change the capacity to 'newMax' bytes, keeping the data, while
+     // others use the buffer; return the new capacity, which may be
+     // more than 'newMax' if the data, the watermarks or a waiting
+     // ReadV or WriteV would not fit.
+     int Resize(int newMax);
+
+     // let the buffer grow by itself, up to 'limit' bytes, when writers
+     // keep finding it full.
+     void SetAutoGrow(int limit);
+
      // Determine whether the buffer is empty
      bool IsEmpty();
 
      // Determine whether the buffer is full
      bool IsFull();
 
+     // Return how many bytes are in the buffer
+     int Count();
+
+     // Return how many times a thread has waited in the buffer
+     int Waits();
+
      // Use for debug,print  the contents of the buffer
      void PrintBuffer(); 
 
+     // record how long each byte waits in the buffer, in a histogram
+     // that PrintBuffer (or PrintLatency) shows with its p50 and p99.
+     void TrackLatency(bool on);
+     void PrintLatency();
+
+     // the number of bytes read since TrackLatency started, and an
+     // upper bound on the latency of the first 'percent' per cent.
+     int LatencyCount();
+     int LatencyPercentile(int percent);
+
 
    private:
      int   in, out, maxsize; 
-     int  *buffer;
-     int count; // Record the number of numbers in the buffer
+     char *buffer;
+     int count; // Record the number of bytes in the buffer
+     int numWaits; // Record the number of times a thread waited
+
+     int writeReserved;  // bytes handed out by WriteReserve, or 0
+     int readReserved;   // bytes handed out by ReadPeek, or 0
+
+     int lowWater;       // data needed to wake a reader
+     int highWater;      // free space needed to wake a writer
+     int readersWaiting, writersWaiting;
+     int bigReaders, bigWriters;   // waiters needing more than the watermark
+     int readWant;       // smallest need of a waiting reader (or less)
+     int writeWant;      // smallest need of a waiting writer (or less)
+
+     // wait until 'target' bytes of data (space) are there, or until
+     // 'deadline' if it is not -1; wake the other side if it can make
+     // progress.  the caller must hold 'lock'.
+     bool WaitForData(int target, int deadline = -1);
+     bool WaitForSpace(int target, int deadline = -1);
+     void WakeReaders();
+     void WakeWriters();
+     void WakeAllReaders();
+     void WakeAllWriters();
+
+     // threads in ReadTimeout/WriteTimeout each sleep on a semaphore of
+     // their own, so that the timer can wake them.
+     struct TimedWaiter {
+          Semaphore *wakeup;
+          TimedWaiter *next;
+     };
+     TimedWaiter *timedReaders, *timedWriters;
+     bool TimedWait(TimedWaiter **queue, int deadline);
+     void WakeTimed(TimedWaiter *queue);
+
+     int *stamps;        // tick each byte was written, or NULL
+     int latencyHist[LatencyBuckets];    // bytes read, by log2 latency
+     int latencyCount, latencyMax;
+     void StampIn(int start, int size);  // the caller must hold 'lock'
+     void StampOut(int start, int size);
+
+     int growLimit;      // SetAutoGrow's limit
+     int vCallers;       // ReadV and WriteV calls in progress
+     int vLargest;       // largest total of any of them (or more)
+     void BeginV(int total);             // the caller must hold 'lock'
+     void EndV();
+     int fullWaits;      // writer waits since a reader found it empty
+     void Reallocate(int newMax);        // the caller must hold 'lock'
+
+     // describe up to 'size' of the 'avail' bytes starting at 'start'
+     // in at most two spans, split at the end of the ring.
+     int Spans(int start, int avail, int size, BufferSpan span[2]);
+
+     // move as many items as possible in one batch; return how many.
+     // the caller must hold 'lock'.
+     int CopyOut(char *data, int size);
+     int CopyIn(char *data, int size);
 
      Lock  *lock;
      Condition *WriteFull, *ReadEmpty; 
+     Condition *Unreserved;   // Resize waits here for Commit/Consume
      
 };
 
+#endif // BOUNDEDBUFFER_H
+
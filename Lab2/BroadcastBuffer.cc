@@ -0,0 +1,202 @@
+// BroadcastBuffer.cc
+//	Routines for a bounded buffer that delivers everything written to
+//	every registered reader.
+//
+//	Free space is 'capacity' less what lies between the slowest
+//	cursor and 'tail'.  Finding the slowest cursor means looking at
+//	all of them, so it is cached in 'slowest' and only recomputed
+//	when a writer runs out of room by the cached value.  Cursors only
+//	move forward, so the cached value can only be too pessimistic.
+//	Likewise, a reader only wakes the writers when it was at the
+//	cached position, as otherwise it cannot have been holding them up.
+//
+// Copyright (c) 2020 MarxYoung.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+#include "BroadcastBuffer.h"
+#include "system.h"
+
+//----------------------------------------------------------------------
+// BroadcastBuffer::BroadcastBuffer
+//	Initialize a BroadcastBuffer of at least 'max_size' bytes, with
+//	room for 'max_consumers' readers, none of them registered yet.
+//----------------------------------------------------------------------
+
+BroadcastBuffer::BroadcastBuffer(int max_size, int max_consumers)
+{
+    ASSERT(max_size > 0 && max_consumers > 0);
+    capacity = 1;
+    while (capacity < (unsigned) max_size)
+	capacity <<= 1;
+    mask = capacity - 1;
+    buffer = new char[capacity];
+    tail = slowest = 0;
+
+    maxConsumers = max_consumers;
+    cursor = new unsigned[maxConsumers];
+    active = new bool[maxConsumers];
+    for (int i = 0; i < maxConsumers; i++)
+	active[i] = false;
+
+    lock = new Lock("BroadcastLock");
+    dataReady = new Condition("BroadcastDataReady");
+    spaceReady = new Condition("BroadcastSpaceReady");
+}
+
+//----------------------------------------------------------------------
+// BroadcastBuffer::~BroadcastBuffer
+//	De-allocate a BroadcastBuffer.
+//----------------------------------------------------------------------
+
+BroadcastBuffer::~BroadcastBuffer()
+{
+    delete [] buffer;
+    delete [] cursor;
+    delete [] active;
+    delete lock;
+    delete dataReady;
+    delete spaceReady;
+}
+
+//----------------------------------------------------------------------
+// BroadcastBuffer::AddConsumer
+//	Register a new reader.  It starts at the current end of the data,
+//	so it sees only what is written from now on.  Return its id, or
+//	-1 if all 'maxConsumers' ids are in use.
+//----------------------------------------------------------------------
+
+int
+BroadcastBuffer::AddConsumer()
+{
+    int id = -1;
+
+    lock->Acquire();
+    for (int i = 0; i < maxConsumers; i++) {
+	if (!active[i]) {
+	    active[i] = true;
+	    cursor[i] = tail;
+	    id = i;
+	    break;
+	}
+    }
+    lock->Release();
+    return id;
+}
+
+//----------------------------------------------------------------------
+// BroadcastBuffer::RemoveConsumer
+//	Unregister reader 'id'.  The space it had not read yet can now
+//	be reused, so wake the writers.
+//----------------------------------------------------------------------
+
+void
+BroadcastBuffer::RemoveConsumer(int id)
+{
+    ASSERT(id >= 0 && id < maxConsumers);
+    lock->Acquire();
+    active[id] = false;
+    spaceReady->Broadcast(lock);
+    lock->Release();
+}
+
+//----------------------------------------------------------------------
+// BroadcastBuffer::Read
+//	Read 'size' bytes for consumer 'id' into 'data'.  Each pass takes
+//	all the data this consumer has not seen, up to what is still
+//	needed, in at most two memcpy calls.
+//----------------------------------------------------------------------
+
+void
+BroadcastBuffer::Read(int id, void *data, int size)
+{
+    char *s = (char *) data;
+    unsigned done = 0;
+
+    ASSERT(id >= 0 && id < maxConsumers);
+    lock->Acquire();
+    ASSERT(active[id]);
+    while (done < (unsigned) size) {
+	unsigned c = cursor[id];
+	unsigned n = tail - c;
+
+	if (n == 0) {
+	    dataReady->Wait(lock);
+	    continue;
+	}
+	if (n > size - done)
+	    n = size - done;
+	unsigned offset = c & mask;
+	unsigned first = capacity - offset;	// up to the end of buffer
+	if (first > n)
+	    first = n;
+	memcpy(s + done, buffer + offset, first);
+	memcpy(s + done + first, buffer, n - first);
+	cursor[id] = c + n;
+	done += n;
+	if (c == slowest)		// we may have been holding writers up
+	    spaceReady->Broadcast(lock);
+    }
+    lock->Release();
+}
+
+//----------------------------------------------------------------------
+// BroadcastBuffer::Write
+//	Write 'size' bytes from 'data'.  Each pass fills all the space
+//	the slowest reader has freed, up to what is left to write, and
+//	then wakes all the readers once.  If no one is registered, the
+//	data is simply dropped as it is overwritten.
+//----------------------------------------------------------------------
+
+void
+BroadcastBuffer::Write(void *data, int size)
+{
+    char *s = (char *) data;
+    unsigned done = 0;
+
+    lock->Acquire();
+    while (done < (unsigned) size) {
+	unsigned room = capacity - (tail - slowest);
+
+	if (room == 0) {
+	    room = capacity - (tail - FindSlowest());
+	    if (room == 0) {
+		spaceReady->Wait(lock);
+		continue;
+	    }
+	}
+	unsigned n = size - done;
+	if (n > room)
+	    n = room;
+	unsigned offset = tail & mask;
+	unsigned first = capacity - offset;
+	if (first > n)
+	    first = n;
+	memcpy(buffer + offset, s + done, first);
+	memcpy(buffer, s + done + first, n - first);
+	tail += n;
+	done += n;
+	dataReady->Broadcast(lock);
+    }
+    lock->Release();
+}
+
+//----------------------------------------------------------------------
+// BroadcastBuffer::FindSlowest
+//	Set 'slowest' to the cursor furthest behind 'tail', or to 'tail'
+//	if there are no consumers, and return it.  The caller must hold
+//	the lock.
+//----------------------------------------------------------------------
+
+unsigned
+BroadcastBuffer::FindSlowest()
+{
+    unsigned behind = 0;
+
+    for (int i = 0; i < maxConsumers; i++)
+	if (active[i] && tail - cursor[i] > behind)
+	    behind = tail - cursor[i];
+    slowest = tail - behind;
+    return slowest;
+}
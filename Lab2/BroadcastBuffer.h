@@ -0,0 +1,61 @@
+// BroadcastBuffer.h
+//	A bounded buffer whose every byte is delivered to every reader.
+//
+//	With BoundedBuffer each byte goes to exactly one reader, so to
+//	send one stream to several consumers the producer has to write it
+//	into one buffer per consumer.  A BroadcastBuffer keeps a single
+//	copy of the data instead.  Each consumer registers with
+//	AddConsumer and gets its own read cursor; reading only moves that
+//	cursor.  A byte's space is reused only once every cursor has
+//	passed it, so writers are held back by the slowest consumer (as in
+//	the LMAX disruptor).  Memory and the cost of a Write do not grow
+//	with the number of consumers.
+//
+//	As in SPSCBuffer, the capacity is a power of two, and 'tail' and
+//	the cursors are free-running counts of bytes.
+//
+// Copyright (c) 2020 MarxYoung.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#ifndef BROADCASTBUFFER_H
+#define BROADCASTBUFFER_H
+
+#include "copyright.h"
+#include "synch.h"
+
+class BroadcastBuffer {
+  public:
+    BroadcastBuffer(int max_size, int max_consumers);
+				// create a buffer of at least 'max_size'
+				// bytes, for up to 'max_consumers' readers
+    ~BroadcastBuffer();		// de-allocate; assume no one is waiting
+
+    int AddConsumer();		// register a reader, which will see all
+				// data written from now on; return its id,
+				// or -1 if there are too many
+    void RemoveConsumer(int id);	// stop holding up writers for 'id'
+
+    void Read(int id, void *data, int size);	// read 'size' bytes for
+						// consumer 'id'
+    void Write(void *data, int size);	// write 'size' bytes for everyone
+
+  private:
+    char *buffer;
+    unsigned capacity;		// size of 'buffer', a power of two
+    unsigned mask;		// capacity - 1
+
+    unsigned tail;		// bytes ever written
+    unsigned *cursor;		// bytes ever read, for each consumer
+    bool *active;		// is this consumer id in use?
+    int maxConsumers;
+    unsigned slowest;		// no consumer is behind this position
+
+    Lock *lock;
+    Condition *dataReady;	// readers wait here for more data
+    Condition *spaceReady;	// writers wait here for the slowest reader
+
+    unsigned FindSlowest();	// recompute 'slowest'
+};
+
+#endif // BROADCASTBUFFER_H
@@ -0,0 +1,272 @@
+// MPMCBuffer.cc
+//	Routines for a bounded buffer shared by many readers and writers.
+//
+//	Each cell carries a sequence number that says whose turn it is.
+//	A cell at position 'pos' is ready for a writer when its sequence
+//	equals 'pos', and ready for a reader when it equals 'pos + 1'.
+//	Having claimed a cell by advancing the matching index with a
+//	compare-and-swap, a writer fills the element and then sets the
+//	sequence to 'pos + 1'; a reader empties it and sets the sequence
+//	to 'pos + number of cells', the position the next writer to use
+//	the cell will have.  The sequence is stored with release semantics
+//	and loaded with acquire semantics, so whoever sees the new number
+//	also sees the element.
+//
+//	Sleeping follows the same scheme as SPSCBuffer, with counts of
+//	waiting threads in place of flags: a waiter announces itself
+//	before its last check, and the other side checks for waiters
+//	after publishing, so one of them always sees the other.
+//
+// Copyright (c) 2020 MarxYoung.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+#include "MPMCBuffer.h"
+#include "system.h"
+
+//----------------------------------------------------------------------
+// MPMCBuffer::MPMCBuffer
+//	Initialize an MPMCBuffer of at least 'max_size' elements of
+//	'elem_size' bytes each.  The algorithm needs at least two cells.
+//----------------------------------------------------------------------
+
+MPMCBuffer::MPMCBuffer(int max_size, int elem_size)
+{
+    unsigned numCells = 2;
+
+    ASSERT(max_size > 0 && elem_size > 0);
+    while (numCells < (unsigned) max_size)
+	numCells <<= 1;
+    mask = numCells - 1;
+    elemSize = elem_size;
+    cellSize = divRoundUp(sizeof(unsigned) + elemSize, sizeof(unsigned))
+							* sizeof(unsigned);
+    cells = new char[numCells * cellSize];
+    for (unsigned i = 0; i < numCells; i++)
+	*Sequence(i) = i;			// every cell free for writers
+    enqueuePos = dequeuePos = 0;
+
+    lock = new Lock("MPMCLock");
+    dataReady = new Condition("MPMCDataReady");
+    spaceReady = new Condition("MPMCSpaceReady");
+    readersWaiting = writersWaiting = 0;
+}
+
+//----------------------------------------------------------------------
+// MPMCBuffer::~MPMCBuffer
+//	De-allocate an MPMCBuffer.
+//----------------------------------------------------------------------
+
+MPMCBuffer::~MPMCBuffer()
+{
+    delete [] cells;
+    delete lock;
+    delete dataReady;
+    delete spaceReady;
+}
+
+//----------------------------------------------------------------------
+// MPMCBuffer::Read
+//	Read 'size' bytes, a whole number of elements, into 'data'.
+//	Take elements as long as there are any; wake the writers only
+//	before going to sleep and once at the end, not per element.
+//----------------------------------------------------------------------
+
+void
+MPMCBuffer::Read(void *data, int size)
+{
+    char *s = (char *) data;
+
+    ASSERT(size % elemSize == 0);
+    for (int done = 0; done < size; ) {
+	if (TryDequeue(s + done))
+	    done += elemSize;
+	else {
+	    WakeWriters();		// there may be room for them by now
+	    WaitForData();
+	}
+    }
+    WakeWriters();
+    if (HasData())			// pass leftover data to another reader
+	WakeReaders();
+}
+
+//----------------------------------------------------------------------
+// MPMCBuffer::Write
+//	Write 'size' bytes, a whole number of elements, from 'data'.
+//----------------------------------------------------------------------
+
+void
+MPMCBuffer::Write(void *data, int size)
+{
+    char *s = (char *) data;
+
+    ASSERT(size % elemSize == 0);
+    for (int done = 0; done < size; ) {
+	if (TryEnqueue(s + done))
+	    done += elemSize;
+	else {
+	    WakeReaders();		// let them make room before we sleep
+	    WaitForSpace();
+	}
+    }
+    WakeReaders();
+    if (HasSpace())			// pass leftover room to another writer
+	WakeWriters();
+}
+
+//----------------------------------------------------------------------
+// MPMCBuffer::TryEnqueue
+//	Claim the next free cell and copy one element into it.  Return
+//	false, without waiting, if the buffer is full.
+//----------------------------------------------------------------------
+
+bool
+MPMCBuffer::TryEnqueue(char *elem)
+{
+    unsigned pos = __atomic_load_n(&enqueuePos, __ATOMIC_RELAXED);
+    unsigned *seq;
+
+    for (;;) {
+	seq = Sequence(pos);
+	int diff = (int) (__atomic_load_n(seq, __ATOMIC_ACQUIRE) - pos);
+
+	if (diff == 0) {			// our turn: try to claim it
+	    if (__atomic_compare_exchange_n(&enqueuePos, &pos, pos + 1,
+			true, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+		break;				// (on failure, 'pos' is reloaded)
+	} else if (diff < 0)
+	    return false;			// cell still holds unread data
+	else					// another writer got here first
+	    pos = __atomic_load_n(&enqueuePos, __ATOMIC_RELAXED);
+    }
+    memcpy((char *) (seq + 1), elem, elemSize);
+    __atomic_store_n(seq, pos + 1, __ATOMIC_RELEASE);	// hand to readers
+    return true;
+}
+
+//----------------------------------------------------------------------
+// MPMCBuffer::TryDequeue
+//	Claim the next full cell and copy its element out.  Return
+//	false, without waiting, if the buffer is empty.
+//----------------------------------------------------------------------
+
+bool
+MPMCBuffer::TryDequeue(char *elem)
+{
+    unsigned pos = __atomic_load_n(&dequeuePos, __ATOMIC_RELAXED);
+    unsigned *seq;
+
+    for (;;) {
+	seq = Sequence(pos);
+	int diff = (int) (__atomic_load_n(seq, __ATOMIC_ACQUIRE) - (pos + 1));
+
+	if (diff == 0) {
+	    if (__atomic_compare_exchange_n(&dequeuePos, &pos, pos + 1,
+			true, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+		break;
+	} else if (diff < 0)
+	    return false;			// cell not written yet
+	else					// another reader got here first
+	    pos = __atomic_load_n(&dequeuePos, __ATOMIC_RELAXED);
+    }
+    memcpy(elem, (char *) (seq + 1), elemSize);
+    __atomic_store_n(seq, pos + mask + 1, __ATOMIC_RELEASE);	// to writers
+    return true;
+}
+
+//----------------------------------------------------------------------
+// MPMCBuffer::HasData
+//	Return true if a reader may find an element to take, i.e. the
+//	next cell to read has been written, or the index has moved on.
+//----------------------------------------------------------------------
+
+bool
+MPMCBuffer::HasData()
+{
+    unsigned pos = __atomic_load_n(&dequeuePos, __ATOMIC_SEQ_CST);
+
+    return (int) (__atomic_load_n(Sequence(pos), __ATOMIC_SEQ_CST)
+							- (pos + 1)) >= 0;
+}
+
+//----------------------------------------------------------------------
+// MPMCBuffer::HasSpace
+//	Return true if a writer may find a free cell.
+//----------------------------------------------------------------------
+
+bool
+MPMCBuffer::HasSpace()
+{
+    unsigned pos = __atomic_load_n(&enqueuePos, __ATOMIC_SEQ_CST);
+
+    return (int) (__atomic_load_n(Sequence(pos), __ATOMIC_SEQ_CST) - pos) >= 0;
+}
+
+//----------------------------------------------------------------------
+// MPMCBuffer::WaitForData
+//	Sleep until there may be an element to read.  Count ourselves
+//	as waiting before the final check, so that a writer publishing
+//	concurrently either sees us or we see its element.
+//----------------------------------------------------------------------
+
+void
+MPMCBuffer::WaitForData()
+{
+    lock->Acquire();
+    __atomic_add_fetch(&readersWaiting, 1, __ATOMIC_SEQ_CST);
+    while (!HasData())
+	dataReady->Wait(lock);
+    __atomic_sub_fetch(&readersWaiting, 1, __ATOMIC_SEQ_CST);
+    lock->Release();
+}
+
+//----------------------------------------------------------------------
+// MPMCBuffer::WaitForSpace
+//	Sleep until there may be a free cell.
+//----------------------------------------------------------------------
+
+void
+MPMCBuffer::WaitForSpace()
+{
+    lock->Acquire();
+    __atomic_add_fetch(&writersWaiting, 1, __ATOMIC_SEQ_CST);
+    while (!HasSpace())
+	spaceReady->Wait(lock);
+    __atomic_sub_fetch(&writersWaiting, 1, __ATOMIC_SEQ_CST);
+    lock->Release();
+}
+
+//----------------------------------------------------------------------
+// MPMCBuffer::WakeReaders
+//	Wake a sleeping reader, if there is one.  The lock is only
+//	taken when someone is waiting.
+//----------------------------------------------------------------------
+
+void
+MPMCBuffer::WakeReaders()
+{
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);	// cells before the count
+    if (__atomic_load_n(&readersWaiting, __ATOMIC_RELAXED) > 0) {
+	lock->Acquire();
+	dataReady->Signal(lock);
+	lock->Release();
+    }
+}
+
+//----------------------------------------------------------------------
+// MPMCBuffer::WakeWriters
+//	Wake a sleeping writer, if there is one.
+//----------------------------------------------------------------------
+
+void
+MPMCBuffer::WakeWriters()
+{
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&writersWaiting, __ATOMIC_RELAXED) > 0) {
+	lock->Acquire();
+	spaceReady->Signal(lock);
+	lock->Release();
+    }
+}
@@ -0,0 +1,77 @@
+// MPMCBuffer.h
+//	A bounded buffer for many reader and many writer threads that
+//	does not serialize them through a single lock.
+//
+//	In BoundedBuffer, every reader and writer takes the same lock,
+//	and a Write of many bytes holds it the whole time it waits for
+//	room.  MPMCBuffer is instead a ring of cells, each stamped with
+//	a sequence number (after D. Vyukov's bounded MPMC queue).  A
+//	writer claims the next cell by advancing 'enqueuePos' with a
+//	compare-and-swap, fills it, and then bumps the cell's sequence to
+//	hand it to the readers; readers do the converse with 'dequeuePos'.
+//	Threads only contend on the one index they are advancing, and
+//	only for as long as the compare-and-swap takes.
+//
+//	Data moves in elements of 'elemSize' bytes, one element per
+//	cell, and Read/Write sizes must be a multiple of it.  As with
+//	BoundedBuffer, the elements of concurrent Writes may interleave.
+//	The lock and conditions are used only to sleep when the buffer
+//	is empty or full.
+//
+// Copyright (c) 2020 MarxYoung.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#ifndef MPMCBUFFER_H
+#define MPMCBUFFER_H
+
+#include "copyright.h"
+#include "synch.h"
+
+#ifndef CacheLineSize
+#define CacheLineSize	64	// bytes; for padding shared indices apart
+#endif
+
+class MPMCBuffer {
+  public:
+    MPMCBuffer(int max_size, int elem_size = 1);
+				// create a buffer of at least 'max_size'
+				// elements (rounded up to a power of two)
+    ~MPMCBuffer();		// de-allocate; assume no one is waiting
+
+    void Read(void *data, int size);	// read 'size' bytes into 'data'
+    void Write(void *data, int size);	// write 'size' bytes from 'data'
+
+  private:
+    char *cells;		// each cell: sequence number, then element
+    int cellSize;		// bytes per cell, including the sequence
+    int elemSize;		// bytes per element
+    unsigned mask;		// number of cells - 1
+
+    Lock *lock;			// only for sleeping, never for the data
+    Condition *dataReady;	// readers sleep here when empty
+    Condition *spaceReady;	// writers sleep here when full
+    int readersWaiting;		// readers (about to be) asleep
+    int writersWaiting;		// writers (about to be) asleep
+
+    char pad0[CacheLineSize];
+    unsigned enqueuePos;	// next cell to write
+    char pad1[CacheLineSize];
+    unsigned dequeuePos;	// next cell to read
+    char pad2[CacheLineSize];
+
+    unsigned *Sequence(unsigned pos)	// the cell for position 'pos'
+	{ return (unsigned *) (cells + (pos & mask) * cellSize); }
+
+    bool TryEnqueue(char *elem);	// add/remove one element, or
+    bool TryDequeue(char *elem);	// return FALSE if full/empty
+    bool HasData();			// is the next cell readable?
+    bool HasSpace();			// is the next cell writable?
+
+    void WaitForData();
+    void WaitForSpace();
+    void WakeReaders();
+    void WakeWriters();
+};
+
+#endif // MPMCBUFFER_H
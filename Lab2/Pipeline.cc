@@ -0,0 +1,278 @@
+// Pipeline.cc
+//	Routines to run a chain of stages connected by bounded buffers.
+//
+//	Each buffer carries item pointers as raw bytes.  A pointer must
+//	never be split between two threads, so every write puts whole
+//	pointers into a buffer at once (with WriteV, which waits for room
+//	for all of them), and every read takes a whole number of them;
+//	the number of bytes in a buffer is then always a whole number of
+//	pointers.
+//
+//	The end of the stream is marked by a special item, EndOfStream.
+//	Close puts one into the first buffer for each worker of the first
+//	stage.  A worker that takes one finishes, and the last worker of
+//	a stage to finish puts one into the next buffer for each worker
+//	of the next stage, or a single one into the output, where Get
+//	turns it into NULL.  Since a worker may take several markers in
+//	one batch, it puts back those it does not need.
+//
+// Copyright (c) 2020 MarxYoung.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+#include "Pipeline.h"
+#include "system.h"
+
+static char endOfStream;
+#define EndOfStream	((void *) &endOfStream)
+
+//----------------------------------------------------------------------
+// StageWorker
+//	Fork can only pass an int, so unpack the stage and run it.
+//----------------------------------------------------------------------
+
+static void
+StageWorker(int arg)
+{
+    PipelineStage *stage = (PipelineStage *) arg;
+
+    stage->pipeline->RunStage(stage);
+}
+
+//----------------------------------------------------------------------
+// Pipeline::Pipeline
+//	Initialize an empty pipeline, whose workers move up to
+//	'batch_size' items at a time.
+//----------------------------------------------------------------------
+
+Pipeline::Pipeline(int batch_size)
+{
+    ASSERT(batch_size > 0);
+    batchSize = batch_size;
+    numStages = 0;
+    output = NULL;
+}
+
+//----------------------------------------------------------------------
+// Pipeline::~Pipeline
+//	De-allocate the stages and buffers.
+//----------------------------------------------------------------------
+
+Pipeline::~Pipeline()
+{
+    for (int i = 0; i < numStages; i++) {
+	delete stages[i]->input;
+	delete stages[i];
+    }
+    delete output;
+}
+
+//----------------------------------------------------------------------
+// Pipeline::AddStage
+//	Add a stage, called 'name', after the last one.  'parallelism'
+//	threads will apply 'function' to the items in a buffer that holds
+//	'capacity' items.
+//----------------------------------------------------------------------
+
+void
+Pipeline::AddStage(char *name, StageFunction function, int parallelism,
+		   int capacity)
+{
+    PipelineStage *stage = new PipelineStage;
+
+    ASSERT(numStages < MaxPipelineStages && output == NULL);
+    ASSERT(parallelism > 0 && capacity > 0);
+    stage->name = name;
+    stage->function = function;
+    stage->parallelism = parallelism;
+    stage->capacity = capacity;
+    stage->input = new BoundedBuffer(capacity * sizeof(void *));
+    stage->pipeline = this;
+    stage->running = parallelism;
+    stage->itemsIn = stage->itemsOut = stage->batches = 0;
+    stage->depthSum = stage->depthMax = 0;
+    stage->endTick = 0;
+    stages[numStages++] = stage;
+}
+
+//----------------------------------------------------------------------
+// Pipeline::Start
+//	Connect each stage to the next, create the output buffer of
+//	'capacity' items, and fork the workers.
+//----------------------------------------------------------------------
+
+void
+Pipeline::Start(int capacity)
+{
+    ASSERT(numStages > 0 && output == NULL && capacity > 0);
+    output = new BoundedBuffer(capacity * sizeof(void *));
+    outputCapacity = capacity;
+    for (int i = 0; i < numStages; i++) {
+	if (i + 1 < numStages) {
+	    stages[i]->output = stages[i + 1]->input;
+	    stages[i]->outputCapacity = stages[i + 1]->capacity;
+	} else {
+	    stages[i]->output = output;
+	    stages[i]->outputCapacity = capacity;
+	}
+    }
+    startTick = stats->totalTicks;
+    for (int i = 0; i < numStages; i++)
+	for (int j = 0; j < stages[i]->parallelism; j++) {
+	    Thread *t = new Thread(stages[i]->name);
+	    t->Fork(StageWorker, (int) stages[i]);
+	}
+}
+
+//----------------------------------------------------------------------
+// Pipeline::Put
+//	Give 'item' to the first stage, waiting if its buffer is full.
+//----------------------------------------------------------------------
+
+void
+Pipeline::Put(void *item)
+{
+    ASSERT(item != NULL && output != NULL);
+    Send(stages[0]->input, stages[0]->capacity, &item, 1);
+}
+
+//----------------------------------------------------------------------
+// Pipeline::Close
+//	Mark the end of the input, one marker per first-stage worker.
+//----------------------------------------------------------------------
+
+void
+Pipeline::Close()
+{
+    for (int i = 0; i < stages[0]->parallelism; i++)
+	Put(EndOfStream);
+}
+
+//----------------------------------------------------------------------
+// Pipeline::Get
+//	Wait for a result of the last stage and return it, or return
+//	NULL once all the items before Close have come out.  Only the
+//	first caller after that sees the NULL.
+//----------------------------------------------------------------------
+
+void *
+Pipeline::Get()
+{
+    void *item;
+    BufferSpan span;
+
+    span.data = (char *) &item;
+    span.size = sizeof(void *);
+    output->ReadV(&span, 1);
+    return (item == EndOfStream) ? NULL : item;
+}
+
+//----------------------------------------------------------------------
+// Pipeline::RunStage
+//	The body of a worker thread.  Take a batch of items, apply the
+//	stage function to each, and pass the results on, until the end
+//	of the stream.
+//----------------------------------------------------------------------
+
+void
+Pipeline::RunStage(PipelineStage *stage)
+{
+    void **in = new void *[batchSize];
+    void **out = new void *[batchSize];
+    int markers = 0;
+
+    while (markers == 0) {
+	int depth = stage->input->Count() / sizeof(void *);
+	int n = stage->input->ReadSome((void *) in, batchSize * sizeof(void *))
+							/ sizeof(void *);
+	int m = 0;
+
+	for (int i = 0; i < n; i++) {
+	    if (in[i] == EndOfStream)
+		markers++;
+	    else if ((out[m] = (*stage->function)(in[i])) != NULL)
+		m++;
+	}
+	Send(stage->output, stage->outputCapacity, out, m);
+
+	IntStatus oldLevel = interrupt->SetLevel(IntOff);
+	stage->itemsIn += n - markers;
+	stage->itemsOut += m;
+	stage->batches++;
+	stage->depthSum += depth;
+	if (depth > stage->depthMax)
+	    stage->depthMax = depth;
+	(void) interrupt->SetLevel(oldLevel);
+    }
+    void *marker = EndOfStream;
+    while (--markers > 0)		// those were for the other workers
+	Send(stage->input, stage->capacity, &marker, 1);
+    delete [] in;
+    delete [] out;
+
+    IntStatus oldLevel = interrupt->SetLevel(IntOff);
+    bool last = (--stage->running == 0);
+    if (last)
+	stage->endTick = stats->totalTicks;
+    (void) interrupt->SetLevel(oldLevel);
+
+    if (last) {				// pass the end on
+	int next;
+
+	for (next = 0; stages[next] != stage; next++)
+	    ;
+	next++;
+	int count = (next < numStages) ? stages[next]->parallelism : 1;
+	for (int i = 0; i < count; i++)
+	    Send(stage->output, stage->outputCapacity, &marker, 1);
+    }
+    DEBUG('t', "Pipeline worker %s finished\n", currentThread->getName());
+}
+
+//----------------------------------------------------------------------
+// Pipeline::Send
+//	Write 'n' item pointers to 'buffer', which holds 'capacity' of
+//	them, as few writes as possible, none splitting a pointer.
+//----------------------------------------------------------------------
+
+void
+Pipeline::Send(BoundedBuffer *buffer, int capacity, void **items, int n)
+{
+    BufferSpan span;
+
+    while (n > 0) {
+	int k = (n < capacity) ? n : capacity;
+
+	span.data = (char *) items;
+	span.size = k * sizeof(void *);
+	buffer->WriteV(&span, 1);
+	items += k;
+	n -= k;
+    }
+}
+
+//----------------------------------------------------------------------
+// Pipeline::PrintStats
+//	For each stage, print how many items went in and out, how many
+//	it handled per thousand ticks, and how full its input was.
+//----------------------------------------------------------------------
+
+void
+Pipeline::PrintStats()
+{
+    printf("Pipeline: %d stages, batches of up to %d items\n",
+	   numStages, batchSize);
+    for (int i = 0; i < numStages; i++) {
+	PipelineStage *s = stages[i];
+	int end = (s->running > 0) ? stats->totalTicks : s->endTick;
+	int elapsed = end - startTick;
+
+	printf("  %-12s x%d: %d in, %d out, %d items/1000 ticks, "
+	       "queue avg %d max %d of %d, %d batches\n",
+	       s->name, s->parallelism, s->itemsIn, s->itemsOut,
+	       elapsed > 0 ? (int) (s->itemsIn * 1000LL / elapsed) : 0,
+	       s->batches > 0 ? s->depthSum / s->batches : 0,
+	       s->depthMax, s->capacity, s->batches);
+    }
+}
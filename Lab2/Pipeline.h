@@ -0,0 +1,89 @@
+// Pipeline.h
+//	A chain of stages, each run by one or more threads, connected by
+//	bounded buffers.
+//
+//	Instead of forking producer, transform and consumer threads by
+//	hand and wiring them to buffers, declare each stage with
+//	AddStage: the function to apply to each item, how many threads
+//	should run it, and how many items the buffer feeding it holds.
+//	Then Start the pipeline, Put items into the first stage, and Get
+//	the results from the last.  Close marks the end of the input;
+//	once everything before it has gone through, Get returns NULL.
+//
+//	Items are pointers, passed along the buffers by value.  Worker
+//	threads take as many items as are waiting, up to a batch, apply
+//	the function to each, and pass the results on with a single
+//	write, so a busy pipeline takes and releases each buffer's lock
+//	once per batch rather than once per item.  With more than one
+//	thread in a stage, items may leave it out of order.
+//
+//	PrintStats shows, for each stage, its throughput and how full the
+//	buffer feeding it was; a slow stage shows up as high throughput
+//	upstream, a full buffer in front of it, and an empty one behind.
+//
+// Copyright (c) 2020 MarxYoung.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include "copyright.h"
+#include "BoundedBuffer.h"
+
+#define MaxPipelineStages	8
+
+// A stage function transforms one item.  Returning NULL drops it.
+typedef void *(*StageFunction)(void *item);
+
+class Pipeline;
+
+struct PipelineStage {
+    char *name;
+    StageFunction function;
+    int parallelism;		// number of worker threads
+    int capacity;		// items the input buffer holds
+    BoundedBuffer *input;	// the buffer feeding this stage
+    BoundedBuffer *output;	// the next stage's input, or the pipeline's
+    int outputCapacity;		// items 'output' holds
+    Pipeline *pipeline;
+
+    int running;		// workers that have not finished
+    int itemsIn, itemsOut;	// items taken from input / passed on
+    int batches;		// reads from 'input'
+    int depthSum, depthMax;	// items waiting in 'input' at each read
+    int endTick;		// when the last worker finished
+};
+
+class Pipeline {
+  public:
+    Pipeline(int batch_size);	// move up to 'batch_size' items at a time
+    ~Pipeline();		// assume the workers have all finished
+
+    void AddStage(char *name, StageFunction function, int parallelism,
+		  int capacity);	// add a stage after the last one, fed
+					// by a buffer of 'capacity' items
+    void Start(int capacity);	// fork the workers; the results go to a
+				// buffer of 'capacity' items
+
+    void Put(void *item);	// give a (non-NULL) item to the first stage
+    void Close();		// no more items will be Put
+    void *Get();		// take a result of the last stage, or NULL
+				// once all the items are through
+
+    void PrintStats();		// throughput and queue depth per stage
+
+    void RunStage(PipelineStage *stage);	// body of a worker thread
+
+  private:
+    int batchSize;
+    PipelineStage *stages[MaxPipelineStages];
+    int numStages;
+    BoundedBuffer *output;	// where the last stage puts its results
+    int outputCapacity;
+    int startTick;
+
+    void Send(BoundedBuffer *buffer, int capacity, void **items, int n);
+};
+
+#endif // PIPELINE_H
@@ -0,0 +1,183 @@
+// PriorityBuffer.cc
+//	Routines for a bounded buffer with priority lanes.
+//
+//	Each lane is a ring of its own, big enough for the whole budget,
+//	since any one lane may end up holding all of it.  What a lane may
+//	write is the space not used by any lane, less the reserves other
+//	lanes are not using; 'reserved' keeps the sum of the unused
+//	reserves up to date, so this is cheap to work out.
+//
+//	Every lane has its own condition for writers, so that freeing
+//	space can wake the writers of each lane that may now go ahead.
+//
+// Copyright (c) 2020 MarxYoung.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+#include "PriorityBuffer.h"
+#include "system.h"
+
+//----------------------------------------------------------------------
+// PriorityBuffer::PriorityBuffer
+//	Initialize a PriorityBuffer of 'num_lanes' empty lanes, sharing
+//	'max_size' bytes, with no reserves.
+//----------------------------------------------------------------------
+
+PriorityBuffer::PriorityBuffer(int max_size, int num_lanes)
+{
+    ASSERT(max_size > 0 && num_lanes > 0);
+    maxsize = max_size;
+    numLanes = num_lanes;
+    total = reserved = 0;
+    lanes = new Lane[numLanes];
+    for (int i = 0; i < numLanes; i++) {
+	lanes[i].buffer = new char[max_size];
+	lanes[i].in = lanes[i].out = lanes[i].count = 0;
+	lanes[i].reserve = 0;
+	lanes[i].spaceFree = new Condition("PriorityLaneSpaceFree");
+    }
+    lock = new Lock("PriorityLock");
+    dataReady = new Condition("PriorityDataReady");
+}
+
+//----------------------------------------------------------------------
+// PriorityBuffer::~PriorityBuffer
+//	De-allocate a PriorityBuffer.
+//----------------------------------------------------------------------
+
+PriorityBuffer::~PriorityBuffer()
+{
+    for (int i = 0; i < numLanes; i++) {
+	delete [] lanes[i].buffer;
+	delete lanes[i].spaceFree;
+    }
+    delete [] lanes;
+    delete lock;
+    delete dataReady;
+}
+
+//----------------------------------------------------------------------
+// PriorityBuffer::SetReserve
+//	Keep 'bytes' of the capacity for 'lane': other lanes can only
+//	fill the buffer up to the point where 'lane' still has that much
+//	room (less what it already holds).  The reserves of all lanes
+//	together must leave some room to share.
+//----------------------------------------------------------------------
+
+void
+PriorityBuffer::SetReserve(int lane, int bytes)
+{
+    ASSERT(lane >= 0 && lane < numLanes && bytes >= 0);
+    lock->Acquire();
+    int sum = bytes;
+    for (int i = 0; i < numLanes; i++)
+	if (i != lane)
+	    sum += lanes[i].reserve;
+    ASSERT(sum < maxsize);
+    reserved -= Unused(&lanes[lane]);
+    lanes[lane].reserve = bytes;
+    reserved += Unused(&lanes[lane]);
+    for (int i = 0; i < numLanes; i++)	// room may have changed for all
+	lanes[i].spaceFree->Broadcast(lock);
+    lock->Release();
+}
+
+//----------------------------------------------------------------------
+// PriorityBuffer::Room
+//	Return how many bytes 'lane' may write now: the free space, less
+//	what is held back for the other lanes.  This is negative if a new
+//	reserve has been set on a buffer already too full to honour it.
+//	The caller must hold the lock.
+//----------------------------------------------------------------------
+
+int
+PriorityBuffer::Room(int lane)
+{
+    return maxsize - total - (reserved - Unused(&lanes[lane]));
+}
+
+//----------------------------------------------------------------------
+// PriorityBuffer::Write
+//	Write 'size' bytes from 'data' into 'lane'.  Each time there is
+//	room, fill as much of it as we can in at most two memcpy calls,
+//	then wake a reader once for the whole batch.
+//----------------------------------------------------------------------
+
+void
+PriorityBuffer::Write(int lane, void *data, int size)
+{
+    char *s = (char *) data;
+    Lane *l = &lanes[lane];
+    int done = 0;
+
+    ASSERT(lane >= 0 && lane < numLanes);
+    lock->Acquire();
+    while (done < size) {
+	int room;
+
+	while ((room = Room(lane)) <= 0)
+	    l->spaceFree->Wait(lock);
+	int n = (size - done < room) ? size - done : room;
+	int first = maxsize - l->in;	// up to the end of the ring
+	if (first > n)
+	    first = n;
+	memcpy(l->buffer + l->in, s + done, first);
+	memcpy(l->buffer, s + done + first, n - first);
+	reserved -= Unused(l);
+	l->in = (l->in + n) % maxsize;
+	l->count += n;
+	reserved += Unused(l);
+	total += n;
+	done += n;
+	dataReady->Signal(lock);
+    }
+    if (Room(lane) > 0)			// pass the remaining room on
+	l->spaceFree->Signal(lock);
+    lock->Release();
+}
+
+//----------------------------------------------------------------------
+// PriorityBuffer::Read
+//	Wait until some lane has data, then read up to 'size' bytes from
+//	the most urgent such lane.  Return the number of bytes read, and
+//	set '*lane' to the lane they came from.  Freeing space may let
+//	writers of any lane proceed, so wake those of each lane that now
+//	has room.
+//----------------------------------------------------------------------
+
+int
+PriorityBuffer::Read(void *data, int size, int *lane)
+{
+    char *s = (char *) data;
+    int i;
+
+    ASSERT(size > 0);
+    lock->Acquire();
+    while (total == 0)
+	dataReady->Wait(lock);
+    for (i = 0; lanes[i].count == 0; i++)
+	;
+    Lane *l = &lanes[i];
+    int n = (size < l->count) ? size : l->count;
+    int first = maxsize - l->out;
+    if (first > n)
+	first = n;
+    memcpy(s, l->buffer + l->out, first);
+    memcpy(s + first, l->buffer, n - first);
+    reserved -= Unused(l);
+    l->out = (l->out + n) % maxsize;
+    l->count -= n;
+    reserved += Unused(l);
+    total -= n;
+
+    for (int j = 0; j < numLanes; j++)
+	if (Room(j) > 0)
+	    lanes[j].spaceFree->Signal(lock);
+    if (total > 0)			// pass what we left on
+	dataReady->Signal(lock);
+    lock->Release();
+    if (lane != NULL)
+	*lane = i;
+    return n;
+}
@@ -0,0 +1,72 @@
+// PriorityBuffer.h
+//	A bounded buffer with several priority lanes sharing one capacity.
+//
+//	With a single BoundedBuffer, a control message written after a
+//	megabyte of bulk data is read after it, too.  A PriorityBuffer
+//	keeps one FIFO lane per priority, lane 0 being the most urgent,
+//	and Read always takes from the most urgent lane that has data.
+//	The lanes draw on a common budget of 'maxsize' bytes, so they
+//	never hold more data than a single buffer would.  Since any one
+//	lane may hold all of it, though, each has a ring of 'maxsize'
+//	bytes, and the memory used is 'numLanes' times that.
+//
+//	A lane may also be given a reserve with SetReserve: space no
+//	other lane can take from it, so that, for instance, a control
+//	lane can always be written even when the data lanes have filled
+//	the rest of the buffer.
+//
+//	Read returns data from one lane at a time, as much as is there,
+//	and says which lane it came from; the bytes of concurrent Writes
+//	to the same lane may interleave, as in BoundedBuffer.
+//
+// Copyright (c) 2020 MarxYoung.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#ifndef PRIORITYBUFFER_H
+#define PRIORITYBUFFER_H
+
+#include "copyright.h"
+#include "synch.h"
+
+class PriorityBuffer {
+  public:
+    PriorityBuffer(int max_size, int num_lanes);
+				// create 'num_lanes' lanes that together
+				// hold at most 'max_size' bytes
+    ~PriorityBuffer();		// de-allocate; assume no one is waiting
+
+    void SetReserve(int lane, int bytes);	// keep 'bytes' of the
+						// capacity for 'lane' alone
+
+    void Write(int lane, void *data, int size);	// write 'size' bytes
+						// from 'data' into 'lane'
+    int Read(void *data, int size, int *lane);	// wait for data, then read
+				// up to 'size' bytes from the most urgent
+				// lane that has any; return how many, and
+				// the lane in '*lane' (if not NULL)
+
+  private:
+    struct Lane {
+	char *buffer;		// a ring of 'maxsize' bytes
+	int in, out;		// where to write and read next
+	int count;		// bytes in the lane
+	int reserve;		// bytes kept for this lane alone
+	Condition *spaceFree;	// writers to this lane wait here
+    };
+
+    Lane *lanes;
+    int numLanes;
+    int maxsize;		// the budget shared by all lanes
+    int total;			// bytes in all lanes together
+    int reserved;		// unused reserve of all lanes together
+
+    Lock *lock;
+    Condition *dataReady;	// readers wait here
+
+    int Unused(Lane *l)		// the part of 'l's reserve it isn't using
+	{ return (l->reserve > l->count) ? l->reserve - l->count : 0; }
+    int Room(int lane);		// bytes 'lane' may write now
+};
+
+#endif // PRIORITYBUFFER_H
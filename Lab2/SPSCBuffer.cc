@@ -0,0 +1,199 @@
+// SPSCBuffer.cc
+//	Routines for a single-producer, single-consumer bounded buffer.
+//
+//	The data path uses no lock.  The writer copies into the free part
+//	of the ring and then publishes it by storing 'tail' with release
+//	semantics; the reader loads 'tail' with acquire semantics, so it
+//	is guaranteed to see the bytes before the index that covers them.
+//	The same holds in the other direction for 'head' and free space.
+//
+//	Sleeping needs more care, since a reader that finds the buffer
+//	empty must not miss the writer's wakeup.  The reader sets
+//	'readerWaiting' and then re-checks 'tail'; the writer stores
+//	'tail' and then checks 'readerWaiting'.  With sequentially
+//	consistent ordering between the store and the load on each side,
+//	at least one of them sees the other's store, so either the reader
+//	finds the data or the writer finds the reader and signals it.
+//	The signal is sent with the lock held, which the reader only
+//	gives up inside Wait, so it cannot slip in before the Wait.
+//
+// Copyright (c) 2020 MarxYoung.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+#include "SPSCBuffer.h"
+#include "system.h"
+
+//----------------------------------------------------------------------
+// SPSCBuffer::SPSCBuffer
+//	Initialize an SPSCBuffer of at least 'max_size' bytes.
+//----------------------------------------------------------------------
+
+SPSCBuffer::SPSCBuffer(int max_size)
+{
+    ASSERT(max_size > 0);
+    capacity = 1;
+    while (capacity < (unsigned) max_size)
+	capacity <<= 1;
+    mask = capacity - 1;
+    buffer = new char[capacity];
+    head = tail = 0;
+    readerWaiting = writerWaiting = false;
+    lock = new Lock("SPSCLock");
+    dataReady = new Condition("SPSCDataReady");
+    spaceReady = new Condition("SPSCSpaceReady");
+}
+
+//----------------------------------------------------------------------
+// SPSCBuffer::~SPSCBuffer
+//	De-allocate an SPSCBuffer.
+//----------------------------------------------------------------------
+
+SPSCBuffer::~SPSCBuffer()
+{
+    delete [] buffer;
+    delete lock;
+    delete dataReady;
+    delete spaceReady;
+}
+
+//----------------------------------------------------------------------
+// SPSCBuffer::Read
+//	Read 'size' bytes into 'data'.  Each pass takes all the data that
+//	is available, up to what is still needed, in at most two memcpy
+//	calls, and then frees the space for the writer.  Sleep only if
+//	the buffer is empty.
+//----------------------------------------------------------------------
+
+void
+SPSCBuffer::Read(void *data, int size)
+{
+    char *s = (char *) data;
+    unsigned done = 0;
+
+    while (done < (unsigned) size) {
+	unsigned h = head;			// only we change 'head'
+	unsigned avail = __atomic_load_n(&tail, __ATOMIC_ACQUIRE) - h;
+
+	if (avail == 0) {
+	    WaitForData();
+	    continue;
+	}
+	unsigned n = size - done;
+	if (n > avail)
+	    n = avail;
+	unsigned offset = h & mask;
+	unsigned first = capacity - offset;	// up to the end of buffer
+	if (first > n)
+	    first = n;
+	memcpy(s + done, buffer + offset, first);
+	memcpy(s + done + first, buffer, n - first);
+	__atomic_store_n(&head, h + n, __ATOMIC_RELEASE);
+	done += n;
+	WakeWriter();
+    }
+}
+
+//----------------------------------------------------------------------
+// SPSCBuffer::Write
+//	Write 'size' bytes from 'data'.  Each pass fills all the free
+//	space, up to what is left to write, and then publishes it to the
+//	reader.  Sleep only if the buffer is full.
+//----------------------------------------------------------------------
+
+void
+SPSCBuffer::Write(void *data, int size)
+{
+    char *s = (char *) data;
+    unsigned done = 0;
+
+    while (done < (unsigned) size) {
+	unsigned t = tail;			// only we change 'tail'
+	unsigned room = capacity - (t - __atomic_load_n(&head, __ATOMIC_ACQUIRE));
+
+	if (room == 0) {
+	    WaitForSpace();
+	    continue;
+	}
+	unsigned n = size - done;
+	if (n > room)
+	    n = room;
+	unsigned offset = t & mask;
+	unsigned first = capacity - offset;	// up to the end of buffer
+	if (first > n)
+	    first = n;
+	memcpy(buffer + offset, s + done, first);
+	memcpy(buffer, s + done + first, n - first);
+	__atomic_store_n(&tail, t + n, __ATOMIC_RELEASE);
+	done += n;
+	WakeReader();
+    }
+}
+
+//----------------------------------------------------------------------
+// SPSCBuffer::WaitForData
+//	Sleep until the writer has published some data.  Announce that
+//	we are waiting before the final check, so that the writer either
+//	sees us or we see its data.
+//----------------------------------------------------------------------
+
+void
+SPSCBuffer::WaitForData()
+{
+    lock->Acquire();
+    __atomic_store_n(&readerWaiting, true, __ATOMIC_SEQ_CST);
+    while (__atomic_load_n(&tail, __ATOMIC_SEQ_CST) == head)
+	dataReady->Wait(lock);
+    __atomic_store_n(&readerWaiting, false, __ATOMIC_RELAXED);
+    lock->Release();
+}
+
+//----------------------------------------------------------------------
+// SPSCBuffer::WaitForSpace
+//	Sleep until the reader has freed some space.
+//----------------------------------------------------------------------
+
+void
+SPSCBuffer::WaitForSpace()
+{
+    lock->Acquire();
+    __atomic_store_n(&writerWaiting, true, __ATOMIC_SEQ_CST);
+    while (tail - __atomic_load_n(&head, __ATOMIC_SEQ_CST) == capacity)
+	spaceReady->Wait(lock);
+    __atomic_store_n(&writerWaiting, false, __ATOMIC_RELAXED);
+    lock->Release();
+}
+
+//----------------------------------------------------------------------
+// SPSCBuffer::WakeReader
+//	Called by the writer after publishing data.  Only if the reader
+//	has announced that it is waiting do we pay for the lock.
+//----------------------------------------------------------------------
+
+void
+SPSCBuffer::WakeReader()
+{
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);	// 'tail' before the flag
+    if (__atomic_load_n(&readerWaiting, __ATOMIC_RELAXED)) {
+	lock->Acquire();
+	dataReady->Signal(lock);
+	lock->Release();
+    }
+}
+
+//----------------------------------------------------------------------
+// SPSCBuffer::WakeWriter
+//	Called by the reader after freeing space.
+//----------------------------------------------------------------------
+
+void
+SPSCBuffer::WakeWriter()
+{
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);	// 'head' before the flag
+    if (__atomic_load_n(&writerWaiting, __ATOMIC_RELAXED)) {
+	lock->Acquire();
+	spaceReady->Signal(lock);
+	lock->Release();
+    }
+}
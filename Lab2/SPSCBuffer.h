@@ -0,0 +1,67 @@
+// SPSCBuffer.h
+//	A bounded buffer for exactly one reader thread and one writer
+//	thread.
+//
+//	With a single producer and a single consumer, the lock and the
+//	two condition variables of BoundedBuffer are pure overhead: the
+//	writer is the only thread that moves 'tail', and the reader the
+//	only one that moves 'head', so each can see how much data or room
+//	there is with a single atomic load of the other's index.  The
+//	lock and conditions are only used to sleep when the buffer is
+//	truly empty (reader) or full (writer).
+//
+//	The capacity is rounded up to a power of two, so that 'head' and
+//	'tail' can run freely and be reduced to an offset with a mask.
+//	'head' and 'tail' are kept on separate cache lines so that, on a
+//	multiprocessor host, the reader and the writer do not keep
+//	stealing the same line from each other.
+//
+// Copyright (c) 2020 MarxYoung.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#ifndef SPSCBUFFER_H
+#define SPSCBUFFER_H
+
+#include "copyright.h"
+#include "synch.h"
+
+#ifndef CacheLineSize
+#define CacheLineSize	64	// bytes; for padding shared indices apart
+#endif
+
+class SPSCBuffer {
+  public:
+    SPSCBuffer(int max_size);	// create a buffer of at least 'max_size'
+				// bytes (rounded up to a power of two)
+    ~SPSCBuffer();		// de-allocate; assume no one is waiting
+
+    void Read(void *data, int size);	// read 'size' bytes into 'data';
+					// called only by the reader
+    void Write(void *data, int size);	// write 'size' bytes from 'data';
+					// called only by the writer
+
+  private:
+    char *buffer;
+    unsigned capacity;		// size of 'buffer', a power of two
+    unsigned mask;		// capacity - 1
+
+    Lock *lock;			// only for sleeping, never for the data
+    Condition *dataReady;	// reader sleeps here when empty
+    Condition *spaceReady;	// writer sleeps here when full
+
+    char pad0[CacheLineSize];
+    unsigned head;		// bytes ever read; written by the reader
+    bool readerWaiting;		// reader is (about to be) asleep
+    char pad1[CacheLineSize];
+    unsigned tail;		// bytes ever written; written by the writer
+    bool writerWaiting;		// writer is (about to be) asleep
+    char pad2[CacheLineSize];
+
+    void WaitForData();		// sleep until the buffer is not empty
+    void WaitForSpace();	// sleep until the buffer is not full
+    void WakeReader();		// wake the reader if it is asleep
+    void WakeWriter();		// wake the writer if it is asleep
+};
+
+#endif // SPSCBUFFER_H
@@ -0,0 +1,387 @@
+// SharedBoundedBuffer.cc
+//	Routines for a bounded buffer in POSIX shared memory.
+//
+//	The mapping starts with a SharedRing header, followed by the
+//	data.  Only the creator initializes the header, and it sets
+//	'magic' last, with release semantics; a process that attaches
+//	waits until it sees 'magic' before touching anything else.  It
+//	only waits for SharedAttachWait milliseconds, though: a creator
+//	that died before initializing the buffer leaves behind an object
+//	that will never be ready, and it is better to fail than to hang.
+//
+//	The mutex is robust, so that a process that dies holding it does
+//	not leave the others blocked for ever.  The next process to lock
+//	it is told, and just marks it consistent again: every operation
+//	moves data before it moves 'head' or 'tail', and moves each of
+//	them with a single store, so the ring is consistent at any point
+//	where its holder could have died.
+//
+//	Indices are free-running byte counts, and the capacity is a power
+//	of two, as in SPSCBuffer.  Since several processes may read or
+//	write at once, every update is made with the shared mutex held.
+//
+// Copyright (c) 2020 MarxYoung.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include <pthread.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "copyright.h"
+#include "SharedBoundedBuffer.h"
+#include "system.h"
+
+#define SharedRingMagic	0x52494e47	// "RING": the header is ready
+#define SharedAttachWait	2000	// ms to wait for the creator
+
+struct SharedRing {
+    unsigned magic;		// SharedRingMagic once initialized
+    unsigned capacity;		// bytes of data, a power of two
+    unsigned head;		// bytes ever read
+    unsigned tail;		// bytes ever written
+    int writeReserved;		// bytes handed out by WriteReserve, or 0
+    int readReserved;		// bytes handed out by ReadPeek, or 0
+    pthread_mutex_t mutex;	// process-shared and robust
+    pthread_cond_t dataReady;	// process-shared; readers wait here
+    pthread_cond_t spaceReady;	// process-shared; writers wait here
+};
+
+// the header, rounded up so that the data is well aligned
+static const int HeaderSize = divRoundUp(sizeof(SharedRing), 64) * 64;
+
+//----------------------------------------------------------------------
+// SharedBoundedBuffer::Open
+//	Create the shared buffer 'name' with at least 'max_size' bytes,
+//	or, if another process already has, map it and wait until it is
+//	initialized.  'name' must start with a '/', as for shm_open.
+//	Return NULL if the buffer is not ready within SharedAttachWait
+//	ms, which means its creator died, or if it vanished or has an
+//	unexpected size; the caller can Unlink the name and start over.
+//----------------------------------------------------------------------
+
+SharedBoundedBuffer *
+SharedBoundedBuffer::Open(char *name, int max_size)
+{
+    unsigned capacity = 1;
+    bool creator = true;
+    int fd, size, waited;
+
+    ASSERT(max_size > 0);
+    while (capacity < (unsigned) max_size)
+	capacity <<= 1;
+    size = HeaderSize + capacity;
+
+    fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+    if (fd >= 0) {
+	int result = ftruncate(fd, size);
+	ASSERT(result == 0);
+    } else {				// someone else created it
+	struct stat st;
+
+	creator = false;
+	fd = shm_open(name, O_RDWR, 0);
+	if (fd < 0) {			// unlinked since we looked
+	    DEBUG('b', "Shared buffer %s vanished\n", name);
+	    return NULL;
+	}
+	for (waited = 0; ; waited++) {	// wait for the creator's ftruncate
+	    int result = fstat(fd, &st);
+	    ASSERT(result == 0);
+	    if (st.st_size > 0)
+		break;
+	    if (waited == SharedAttachWait) {
+		DEBUG('b', "Shared buffer %s was never sized\n", name);
+		close(fd);
+		return NULL;
+	    }
+	    usleep(1000);
+	}
+	size = st.st_size;
+    }
+    void *base = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED,
+								fd, 0);
+    ASSERT(base != MAP_FAILED);
+    close(fd);				// the mapping keeps the object alive
+    SharedRing *header = (SharedRing *) base;
+
+    if (creator) {
+	pthread_mutexattr_t ma;
+	pthread_condattr_t ca;
+
+	header->capacity = capacity;
+	header->head = header->tail = 0;
+	header->writeReserved = header->readReserved = 0;
+	pthread_mutexattr_init(&ma);
+	pthread_mutexattr_setpshared(&ma, PTHREAD_PROCESS_SHARED);
+	pthread_mutexattr_setrobust(&ma, PTHREAD_MUTEX_ROBUST);
+	pthread_mutex_init(&header->mutex, &ma);
+	pthread_mutexattr_destroy(&ma);
+	pthread_condattr_init(&ca);
+	pthread_condattr_setpshared(&ca, PTHREAD_PROCESS_SHARED);
+	pthread_cond_init(&header->dataReady, &ca);
+	pthread_cond_init(&header->spaceReady, &ca);
+	pthread_condattr_destroy(&ca);
+	__atomic_store_n(&header->magic, SharedRingMagic, __ATOMIC_RELEASE);
+    } else {
+	for (waited = 0; __atomic_load_n(&header->magic, __ATOMIC_ACQUIRE)
+					!= SharedRingMagic; waited++) {
+	    if (waited == SharedAttachWait) {
+		DEBUG('b', "Shared buffer %s was never initialized\n", name);
+		munmap(base, size);
+		return NULL;
+	    }
+	    usleep(1000);
+	}
+	if (size != HeaderSize + (int) header->capacity) {
+	    DEBUG('b', "Shared buffer %s has the wrong size\n", name);
+	    munmap(base, size);
+	    return NULL;
+	}
+    }
+    DEBUG('b', "%s shared buffer %s, %d bytes\n",
+	  creator ? "Created" : "Attached to", name, header->capacity);
+    return new SharedBoundedBuffer(base, size);
+}
+
+//----------------------------------------------------------------------
+// SharedBoundedBuffer::SharedBoundedBuffer
+//	Wrap the 'size' bytes mapped at 'base', which Open has made
+//	ready.
+//----------------------------------------------------------------------
+
+SharedBoundedBuffer::SharedBoundedBuffer(void *base, int size)
+{
+    ring = (SharedRing *) base;
+    buffer = (char *) base + HeaderSize;
+    mapSize = size;
+}
+
+//----------------------------------------------------------------------
+// SharedBoundedBuffer::~SharedBoundedBuffer
+//	Unmap the buffer from this process.  The shared object stays
+//	until it is unlinked and every process has unmapped it.
+//----------------------------------------------------------------------
+
+SharedBoundedBuffer::~SharedBoundedBuffer()
+{
+    munmap((void *) ring, mapSize);
+}
+
+//----------------------------------------------------------------------
+// SharedBoundedBuffer::Unlink
+//	Remove the name 'name', so that the buffer goes away once the
+//	last process unmaps it.
+//----------------------------------------------------------------------
+
+void
+SharedBoundedBuffer::Unlink(char *name)
+{
+    shm_unlink(name);
+}
+
+//----------------------------------------------------------------------
+// SharedBoundedBuffer::Acquire, SharedBoundedBuffer::Release
+//	Acquire and release the process-shared mutex.  If its last
+//	holder died, the ring is still consistent (see above), so take
+//	the mutex over.
+//----------------------------------------------------------------------
+
+void
+SharedBoundedBuffer::Acquire()
+{
+    if (pthread_mutex_lock(&ring->mutex) == EOWNERDEAD) {
+	DEBUG('b', "Recovered shared buffer mutex from a dead process\n");
+	pthread_mutex_consistent(&ring->mutex);
+    }
+}
+
+void
+SharedBoundedBuffer::Release()
+{
+    pthread_mutex_unlock(&ring->mutex);
+}
+
+//----------------------------------------------------------------------
+// SharedWait
+//	Wait on 'cond', and take over 'mutex' as in Acquire if its holder
+//	died meanwhile.
+//----------------------------------------------------------------------
+
+static void
+SharedWait(pthread_cond_t *cond, pthread_mutex_t *mutex)
+{
+    if (pthread_cond_wait(cond, mutex) == EOWNERDEAD) {
+	DEBUG('b', "Recovered shared buffer mutex from a dead process\n");
+	pthread_mutex_consistent(mutex);
+    }
+}
+
+//----------------------------------------------------------------------
+// SharedBoundedBuffer::Read
+//	Read 'size' bytes into 'data', copying straight out of the shared
+//	ring as much as is available each time.
+//----------------------------------------------------------------------
+
+void
+SharedBoundedBuffer::Read(void *data, int size)
+{
+    char *s = (char *) data;
+    int done = 0;
+    BufferSpan span[2];
+
+    Acquire();
+    while (done < size) {
+	while (ring->tail == ring->head || ring->readReserved > 0)
+	    SharedWait(&ring->dataReady, &ring->mutex);
+	int n = Spans(ring->head, ring->tail - ring->head, size - done, span);
+	memcpy(s + done, span[0].data, span[0].size);
+	memcpy(s + done + span[0].size, span[1].data, span[1].size);
+	ring->head += n;
+	done += n;
+	pthread_cond_signal(&ring->spaceReady);
+    }
+    if (ring->tail != ring->head)	// pass what we left on
+	pthread_cond_signal(&ring->dataReady);
+    Release();
+}
+
+//----------------------------------------------------------------------
+// SharedBoundedBuffer::Write
+//	Write 'size' bytes from 'data', copying straight into the shared
+//	ring as much as fits each time.
+//----------------------------------------------------------------------
+
+void
+SharedBoundedBuffer::Write(void *data, int size)
+{
+    char *s = (char *) data;
+    int done = 0;
+    BufferSpan span[2];
+
+    Acquire();
+    while (done < size) {
+	while (ring->tail - ring->head == ring->capacity
+					|| ring->writeReserved > 0)
+	    SharedWait(&ring->spaceReady, &ring->mutex);
+	int n = Spans(ring->tail, ring->capacity - (ring->tail - ring->head),
+							size - done, span);
+	memcpy(span[0].data, s + done, span[0].size);
+	memcpy(span[1].data, s + done + span[0].size, span[1].size);
+	ring->tail += n;
+	done += n;
+	pthread_cond_signal(&ring->dataReady);
+    }
+    if (ring->tail - ring->head != ring->capacity)
+	pthread_cond_signal(&ring->spaceReady);
+    Release();
+}
+
+//----------------------------------------------------------------------
+// SharedBoundedBuffer::WriteReserve
+//	Wait until there is room, then describe up to 'size' free bytes
+//	in 'span' and return how many.  Other writers wait until the
+//	matching WriteCommit.
+//----------------------------------------------------------------------
+
+int
+SharedBoundedBuffer::WriteReserve(int size, BufferSpan span[2])
+{
+    int n;
+
+    ASSERT(size > 0);
+    Acquire();
+    while (ring->tail - ring->head == ring->capacity
+					|| ring->writeReserved > 0)
+	SharedWait(&ring->spaceReady, &ring->mutex);
+    n = Spans(ring->tail, ring->capacity - (ring->tail - ring->head),
+								size, span);
+    ring->writeReserved = n;
+    Release();
+    return n;
+}
+
+//----------------------------------------------------------------------
+// SharedBoundedBuffer::WriteCommit
+//	Publish the first 'size' of the bytes reserved by WriteReserve.
+//----------------------------------------------------------------------
+
+void
+SharedBoundedBuffer::WriteCommit(int size)
+{
+    Acquire();
+    ASSERT(ring->writeReserved > 0 && size >= 0
+					&& size <= ring->writeReserved);
+    ring->tail += size;
+    ring->writeReserved = 0;
+    pthread_cond_signal(&ring->dataReady);
+    pthread_cond_broadcast(&ring->spaceReady);	// let the next writer in
+    Release();
+}
+
+//----------------------------------------------------------------------
+// SharedBoundedBuffer::ReadPeek
+//	Wait until there is data, then describe up to 'size' bytes of it
+//	in 'span' and return how many.  Other readers wait until the
+//	matching ReadConsume.
+//----------------------------------------------------------------------
+
+int
+SharedBoundedBuffer::ReadPeek(int size, BufferSpan span[2])
+{
+    int n;
+
+    ASSERT(size > 0);
+    Acquire();
+    while (ring->tail == ring->head || ring->readReserved > 0)
+	SharedWait(&ring->dataReady, &ring->mutex);
+    n = Spans(ring->head, ring->tail - ring->head, size, span);
+    ring->readReserved = n;
+    Release();
+    return n;
+}
+
+//----------------------------------------------------------------------
+// SharedBoundedBuffer::ReadConsume
+//	Remove the first 'size' of the bytes described by ReadPeek.
+//----------------------------------------------------------------------
+
+void
+SharedBoundedBuffer::ReadConsume(int size)
+{
+    Acquire();
+    ASSERT(ring->readReserved > 0 && size >= 0
+					&& size <= ring->readReserved);
+    ring->head += size;
+    ring->readReserved = 0;
+    pthread_cond_signal(&ring->spaceReady);
+    pthread_cond_broadcast(&ring->dataReady);	// let the next reader in
+    Release();
+}
+
+//----------------------------------------------------------------------
+// SharedBoundedBuffer::Spans
+//	Describe up to 'size' of the 'avail' bytes starting at position
+//	'start' in at most two spans, split at the end of the ring.
+//	Return the total.
+//----------------------------------------------------------------------
+
+int
+SharedBoundedBuffer::Spans(unsigned start, unsigned avail, int size,
+							BufferSpan span[2])
+{
+    unsigned offset = start & (ring->capacity - 1);
+    unsigned n = ((unsigned) size < avail) ? size : avail;
+    unsigned first = ring->capacity - offset;
+
+    if (first > n)
+	first = n;
+    span[0].data = buffer + offset;
+    span[0].size = first;
+    span[1].data = buffer;
+    span[1].size = n - first;
+    return n;
+}
@@ -0,0 +1,76 @@
+// SharedBoundedBuffer.h
+//	A bounded buffer that can be shared by separate Nachos processes
+//	on the same host.
+//
+//	The ring, its indices and the synchronization variables all live
+//	in a named POSIX shared-memory object, which every process maps
+//	with the same name.  The first process to Open a name creates and
+//	initializes the buffer; later ones attach to it.  Waiting is done
+//	with a process-shared pthread mutex and condition variables, which
+//	on Linux sleep in the kernel on a futex in the shared mapping.
+//
+//	Read and Write copy data straight between the caller's memory and
+//	the shared ring, so each byte is copied once on its way from one
+//	process to another.  WriteReserve/WriteCommit and ReadPeek/
+//	ReadConsume work as in BoundedBuffer, letting a process build or
+//	parse data in the ring itself with no copy at all.
+//
+//	Note that these waits block the whole host process, not just the
+//	calling Nachos thread, since the Nachos scheduler knows nothing of
+//	them.  Use this buffer only between processes, never between two
+//	threads of the same Nachos process.
+//
+//	The shared object outlives the processes that use it, even when
+//	they crash.  A later run that uses the same name attaches to the
+//	old buffer, with whatever data it still held.  If the creator died
+//	before initializing it, Open gives up after a short wait and
+//	returns NULL.  So Unlink the name before a new set of processes
+//	starts using it, or after such a failure.
+//	A process that dies holding the mutex is recovered from, but one
+//	that dies with a WriteReserve or ReadPeek outstanding leaves the
+//	other writers or readers waiting for good.
+//
+// Copyright (c) 2020 MarxYoung.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#ifndef SHAREDBOUNDEDBUFFER_H
+#define SHAREDBOUNDEDBUFFER_H
+
+#include "copyright.h"
+#include "BoundedBuffer.h"
+
+struct SharedRing;		// the part that lives in shared memory
+
+class SharedBoundedBuffer {
+  public:
+    static SharedBoundedBuffer *Open(char *name, int max_size);
+				// create the buffer called 'name', of at
+				// least 'max_size' bytes, or attach to it
+				// if it exists; NULL if it never gets ready
+    ~SharedBoundedBuffer();	// unmap; the buffer itself lives on
+    static void Unlink(char *name);	// remove the buffer's name, once
+					// no new process needs to attach
+
+    void Read(void *data, int size);	// read 'size' bytes into 'data'
+    void Write(void *data, int size);	// write 'size' bytes from 'data'
+
+    // zero-copy access, as in BoundedBuffer
+    int WriteReserve(int size, BufferSpan span[2]);
+    void WriteCommit(int size);
+    int ReadPeek(int size, BufferSpan span[2]);
+    void ReadConsume(int size);
+
+  private:
+    SharedBoundedBuffer(void *base, int size);	// wrap a mapping; see Open
+
+    SharedRing *ring;		// header at the start of the mapping
+    char *buffer;		// the data, right after the header
+    int mapSize;		// bytes mapped
+
+    int Spans(unsigned start, unsigned avail, int size, BufferSpan span[2]);
+    void Acquire();		// take and drop the shared mutex
+    void Release();
+};
+
+#endif // SHAREDBOUNDEDBUFFER_H
@@ -0,0 +1,147 @@
+// StaticBoundedBuffer.h
+//	A bounded buffer of objects of type T, with a capacity fixed at
+//	compile time.
+//
+//	BoundedBuffer moves bytes, allocates its ring on the heap, and
+//	reduces every index modulo a capacity only known at run time.
+//	StaticBoundedBuffer<T, N> holds N objects of type T in storage
+//	inside the object itself, so creating one needs no allocation,
+//	and since N must be a power of two, an index is reduced with a
+//	mask the compiler can see.  Objects are moved in and out of the
+//	buffer (with std::move, when compiled as C++11 or later), not
+//	copied, and are only constructed while they are in the buffer.
+//
+//	Since StaticBoundedBuffer is a template, all of its code lives in
+//	this file.
+//
+// Copyright (c) 2020 MarxYoung.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#ifndef STATICBOUNDEDBUFFER_H
+#define STATICBOUNDEDBUFFER_H
+
+#include "copyright.h"
+#include "synch.h"
+#include "AlignedStorage.h"
+
+#include <new>
+
+#if __cplusplus >= 201103L
+#include <utility>
+#define StaticBufferMove(x)	std::move(x)
+#else
+#define StaticBufferMove(x)	(x)
+#endif
+
+template <class T, unsigned N>
+class StaticBoundedBuffer {
+  public:
+    StaticBoundedBuffer();
+    ~StaticBoundedBuffer();	// destroy the objects still in the buffer;
+				// assume no one is waiting
+
+    void Write(T *items, int n = 1);	// move n objects into the buffer
+    void Read(T *items, int n = 1);	// move n objects out of the buffer,
+					// assigning them to items[0..n-1]
+
+  private:
+    // fails to compile unless N is a power of two
+    typedef char CapacityIsPowerOfTwo[(N > 0 && (N & (N - 1)) == 0) ? 1 : -1];
+
+    AlignedStorage<T> slots[N];	// uninitialized storage for N objects
+    unsigned in;		// objects ever written
+    unsigned out;		// objects ever read
+    Lock lock;
+    Condition notFull;		// writers wait here
+    Condition notEmpty;		// readers wait here
+
+    T *Object(unsigned pos) { return slots[pos & (N - 1)].Object(); }
+};
+
+//----------------------------------------------------------------------
+// StaticBoundedBuffer<T, N>::StaticBoundedBuffer
+// 	Initialize an empty buffer.  No objects are constructed until
+//	they are written.
+//----------------------------------------------------------------------
+
+template <class T, unsigned N>
+StaticBoundedBuffer<T, N>::StaticBoundedBuffer()
+    : lock("StaticBufferLock"), notFull("StaticBufferNotFull"),
+      notEmpty("StaticBufferNotEmpty")
+{
+    in = out = 0;
+}
+
+//----------------------------------------------------------------------
+// StaticBoundedBuffer<T, N>::~StaticBoundedBuffer
+// 	Destroy the objects that were never read.
+//----------------------------------------------------------------------
+
+template <class T, unsigned N>
+StaticBoundedBuffer<T, N>::~StaticBoundedBuffer()
+{
+    for (; out != in; out++)
+	Object(out)->~T();
+}
+
+//----------------------------------------------------------------------
+// StaticBoundedBuffer<T, N>::Write
+// 	Move 'n' objects from 'items' into the buffer, waiting for room
+//	as needed.  Each time there is room, fill all of it, and wake a
+//	reader once for the whole batch.
+//----------------------------------------------------------------------
+
+template <class T, unsigned N>
+void
+StaticBoundedBuffer<T, N>::Write(T *items, int n)
+{
+    int done = 0;
+
+    lock.Acquire();
+    while (done < n) {
+	while (in - out == N)
+	    notFull.Wait(&lock);
+	while (done < n && in - out < N) {
+	    new (Object(in)) T(StaticBufferMove(items[done]));
+	    in++;
+	    done++;
+	}
+	notEmpty.Signal(&lock);
+    }
+    if (in - out < N)		// pass the remaining room on
+	notFull.Signal(&lock);
+    lock.Release();
+}
+
+//----------------------------------------------------------------------
+// StaticBoundedBuffer<T, N>::Read
+// 	Move 'n' objects out of the buffer into 'items', waiting for
+//	them as needed.
+//----------------------------------------------------------------------
+
+template <class T, unsigned N>
+void
+StaticBoundedBuffer<T, N>::Read(T *items, int n)
+{
+    int done = 0;
+
+    lock.Acquire();
+    while (done < n) {
+	while (in == out)
+	    notEmpty.Wait(&lock);
+	while (done < n && in != out) {
+	    T *object = Object(out);
+	    items[done] = StaticBufferMove(*object);
+	    object->~T();
+	    out++;
+	    done++;
+	}
+	notFull.Signal(&lock);
+    }
+    if (in != out)		// pass what we left on
+	notEmpty.Signal(&lock);
+    lock.Release();
+}
+
+#endif // STATICBOUNDEDBUFFER_H
@@ -1,15 +1,44 @@
 # include "Table.h"
+# include "system.h"
+
+Table *Table::allTables = NULL;
 
 //----------------------------------------------------------------------
 // Table::Table
 // 	Create a table to hold at most 'size' entries.
+//	If 'reverseIndex' is true, also build a hash table from object
+//	to index for Find, at least twice as large as the table.
 //----------------------------------------------------------------------
-Table::Table(int size)
+Table::Table(int size, bool reverseIndex)
 {
 	this->size = size;
     elem = new void *[this->size + 1]();
 	lock = new Lock("TableLock");
-	
+
+	epoch = 0;
+	for (int i = 0; i < EpochBuckets; i++)
+		readers[i] = 0;
+	retired = new unsigned[this->size];
+	for (int i = 0; i < this->size; i++)
+		retired[i] = epoch - 2;	// never released: reusable now
+
+	byObject = NULL;
+	hashMask = 0;
+	if (reverseIndex) {
+		int hashSize = 1;
+		while (hashSize < 2 * this->size)
+			hashSize <<= 1;
+		byObject = new int[hashSize];
+		for (int i = 0; i < hashSize; i++)
+			byObject[i] = -1;
+		hashMask = hashSize - 1;
+	}
+
+	inUse = highWater = 0;
+	numAllocs = numFailures = 0;
+	slotsScanned = lockWaits = lockWaitTicks = 0;
+	nextTable = allTables;
+	allTables = this;
 }
 
 //----------------------------------------------------------------------
@@ -20,29 +49,59 @@ Table::~Table()
 {
 	delete elem;
     delete lock;
+	delete [] retired;
+	delete [] byObject;
+
+	Table **p = &allTables;
+	while (*p != this)
+		p = &(*p)->nextTable;
+	*p = nextTable;
 }
 
 //----------------------------------------------------------------------
 // Table::Alloc
 //  Allocate a table slot for 'object'.
 //  Return the table index for the slot or -1 on error.
+//
+//  A free slot is only used once every reader that might still hold
+//  its index has finished, i.e. two epochs after it was released.
+//
+//  The time spent acquiring the lock only counts if Alloc actually
+//  had to wait for it (see AcquireLock).
 //----------------------------------------------------------------------
 int Table::Alloc(void* object)
 {
-    int index = -1;
+	int index = -1;
 
-    if(object == NULL)
-        return index;
-	lock->Acquire();
+	if(object == NULL)
+	{
+		IntStatus oldLevel = interrupt->SetLevel(IntOff);
+		numFailures++;		// a failed Alloc, if a cheap one
+		(void) interrupt->SetLevel(oldLevel);
+		return index;
+	}
+	AcquireLock();
+	TryAdvance();	// with no readers about, two advances make
+	TryAdvance();	// the slots released so far reusable at once
 	for(int i = 0; i < size; i++)
 	{
-		if(elem[i] == NULL)
+		slotsScanned++;
+		if(elem[i] == NULL && epoch - retired[i] >= 2)	// mod 2^32
 		{
 			elem[i] = object;
 			index= i;
+			if (byObject != NULL)
+				AddToIndex(i);
 			break;
 		}
 	}
+	if (index == -1)
+		numFailures++;
+	else {
+		numAllocs++;
+		if (++inUse > highWater)
+			highWater = inUse;
+	}
 	lock->Release();
 	return index;
 }
@@ -61,10 +120,209 @@ void* Table::Get(int index)
 
 //----------------------------------------------------------------------
 // Table::Release
-// 	Free a table slot.
+// 	Free a table slot, recording the epoch it was released in.
 //----------------------------------------------------------------------
 void Table::Release(int index)
 {
 	ASSERT(index >= 0 && index < size);
+	IntStatus oldLevel = interrupt->SetLevel(IntOff);
+	if (elem[index] != NULL) {
+		inUse--;
+		if (byObject != NULL)
+			RemoveFromIndex(index);
+	}
 	elem[index] = NULL;
+	retired[index] = epoch;
+	(void) interrupt->SetLevel(oldLevel);
+}
+
+//----------------------------------------------------------------------
+// Table::Find
+// 	Return the index of a slot holding 'object', or -1 if the
+//	object is not in the table.  The table must have been created
+//	with a reverse index.
+//----------------------------------------------------------------------
+int Table::Find(void *object)
+{
+	ASSERT(byObject != NULL);
+	int index = -1;
+
+	IntStatus oldLevel = interrupt->SetLevel(IntOff);
+	for (int i = Hash(object); byObject[i] != -1; i = (i + 1) & hashMask)
+	{
+		if (elem[byObject[i]] == object)
+		{
+			index = byObject[i];
+			break;
+		}
+	}
+	(void) interrupt->SetLevel(oldLevel);
+	return index;
+}
+
+//----------------------------------------------------------------------
+// Table::Hash
+// 	Return the bucket of the reverse index in which to start looking
+//	for 'object'.  The low bits of a pointer are mostly zero, so
+//	scramble it with a multiplicative hash first.
+//----------------------------------------------------------------------
+int Table::Hash(void *object)
+{
+	unsigned long key = (unsigned long) object;
+	return (int) (((key >> 3) * 2654435761UL) >> 7) & hashMask;
+}
+
+//----------------------------------------------------------------------
+// Table::AddToIndex
+// 	Enter the object in slot 'index' into the reverse index, in the
+//	first empty bucket at or after its hash (linear probing).  The
+//	index is twice the size of the table, so there always is one.
+//----------------------------------------------------------------------
+void Table::AddToIndex(int index)
+{
+	int i = Hash(elem[index]);
+	while (byObject[i] != -1)
+		i = (i + 1) & hashMask;
+	byObject[i] = index;
+}
+
+//----------------------------------------------------------------------
+// Table::RemoveFromIndex
+// 	Remove slot 'index' from the reverse index; its object must
+//	still be in elem[index].  Rather than leave a tombstone, move
+//	back any later entry in the same run whose probe sequence
+//	passes the hole, so that lookups never scan dead buckets.
+//----------------------------------------------------------------------
+void Table::RemoveFromIndex(int index)
+{
+	int hole = Hash(elem[index]);
+	while (byObject[hole] != index)
+		hole = (hole + 1) & hashMask;
+
+	for (int i = (hole + 1) & hashMask; byObject[i] != -1;
+						i = (i + 1) & hashMask)
+	{
+		int home = Hash(elem[byObject[i]]);
+		if (((i - home) & hashMask) >= ((i - hole) & hashMask))
+		{
+			byObject[hole] = byObject[i];	// hole is on its path
+			hole = i;
+		}
+	}
+	byObject[hole] = -1;
+}
+
+//----------------------------------------------------------------------
+// Table::BeginRead
+// 	Enter a read-side critical section.  Count the reader against
+//	the current epoch, and return that epoch for EndRead.
+//----------------------------------------------------------------------
+int Table::BeginRead()
+{
+	IntStatus oldLevel = interrupt->SetLevel(IntOff);
+	int readEpoch = (int) epoch;
+	readers[epoch % EpochBuckets]++;
+	(void) interrupt->SetLevel(oldLevel);
+	return readEpoch;
+}
+
+//----------------------------------------------------------------------
+// Table::EndRead
+// 	Leave the read-side critical section entered in 'readEpoch'.
+//----------------------------------------------------------------------
+void Table::EndRead(int readEpoch)
+{
+	IntStatus oldLevel = interrupt->SetLevel(IntOff);
+	unsigned bucket = (unsigned) readEpoch % EpochBuckets;
+
+	ASSERT(readers[bucket] > 0);
+	readers[bucket]--;
+	(void) interrupt->SetLevel(oldLevel);
+}
+
+//----------------------------------------------------------------------
+// Table::TryAdvance
+// 	Move to the next epoch if no reader is still inside the
+//	previous one.  Readers are thus always in the current or the
+//	previous epoch, so a slot released in epoch e can no longer be
+//	seen by any reader once the epoch reaches e + 2.  When the epoch
+//	wraps from 2^32 - 1 to 0, the bucket goes from 3 to 0 as usual.
+//----------------------------------------------------------------------
+void Table::TryAdvance()
+{
+	IntStatus oldLevel = interrupt->SetLevel(IntOff);
+	if (readers[(epoch - 1) % EpochBuckets] == 0)
+		epoch++;
+	(void) interrupt->SetLevel(oldLevel);
+}
+
+//----------------------------------------------------------------------
+// Table::AcquireLock
+// 	Acquire the table lock, and if we had to sleep for it, count
+//	the wait and the ticks we were blocked.  Interrupts are off
+//	from before we look at the clock to after, so the ticks that
+//	enabling them costs are not counted, and an uncontended Acquire
+//	adds nothing; and no other thread can sleep on the lock unless
+//	we do too.
+//----------------------------------------------------------------------
+void Table::AcquireLock()
+{
+	IntStatus oldLevel = interrupt->SetLevel(IntOff);
+	int sleeps = lock->Sleeps();
+	int start = stats->totalTicks;
+
+	lock->Acquire();
+	if (lock->Sleeps() != sleeps) {
+		lockWaits++;
+		lockWaitTicks += stats->totalTicks - start;
+	}
+	(void) interrupt->SetLevel(oldLevel);
+}
+
+//----------------------------------------------------------------------
+// Table::Failures, Table::LockWaits, Table::LockWaitTicks
+// 	Return how many calls to Alloc failed, how many had to wait for
+//	the table lock, and the ticks they spent waiting.
+//----------------------------------------------------------------------
+int Table::Failures()
+{
+	return numFailures;
+}
+
+int Table::LockWaits()
+{
+	return lockWaits;
+}
+
+int Table::LockWaitTicks()
+{
+	return lockWaitTicks;
+}
+
+//----------------------------------------------------------------------
+// Table::PrintStats
+// 	Print how full the table is and has been, how far Alloc has
+//	to search for a free slot, and how often and long it waits for
+//	the lock.
+//----------------------------------------------------------------------
+void Table::PrintStats()
+{
+	int calls = numAllocs + numFailures;
+
+	printf("Table of %d entries: %d in use, high water %d\n",
+		size, inUse, highWater);
+	printf("  Alloc: %d calls, %d failed, %.1f slots scanned per call, "
+		"%d waited for lock, %d ticks\n", calls, numFailures,
+		calls ? (double) slotsScanned / calls : 0.0, lockWaits,
+		lockWaitTicks);
+}
+
+//----------------------------------------------------------------------
+// Table::PrintAllStats
+// 	Print the statistics of every Table still allocated.
+//----------------------------------------------------------------------
+void Table::PrintAllStats()
+{
+	for (Table *t = allTables; t != NULL; t = t->nextTable)
+		t->PrintStats();
 }
@@ -18,7 +18,29 @@ of the objects stored in the Table.  The object pointer in each Table
 entry is untyped (void*).  It is necessary to cast an object pointer
 to a (void *) before storing it in the table, and to cast it back to
 its correct type (e.g., (Process *)) after retrieving it with Get.
-A more sophisticated solution would use parameterized types.aux
+A more sophisticated solution would use parameterized types;
+see TypedTable.h.
+
+Get does not take the table lock.  A thread that looks up an index
+and then uses the object, while another thread releases that index,
+could see a new object allocated into the same slot.  To prevent this,
+the lookup can be bracketed by BeginRead and EndRead.  A released slot
+is not handed out again by Alloc until every reader that was inside
+such a bracket when the slot was released has left it.  This is
+epoch-based reclamation: the table keeps a global epoch, each reader
+is counted against the epoch it entered in, and the epoch only
+advances once no reader is left in the previous one.  A slot released
+in epoch e can therefore be reused once the epoch reaches e + 2.
+The epoch is unsigned and is allowed to wrap around: ages are taken
+modulo 2^32, and readers are counted in 4 buckets, a divisor of 2^32,
+so that the bucket of an epoch does not jump when it wraps.
+
+Finding the index that holds a given object would normally need a
+scan of the whole table.  A table created with 'reverseIndex' set
+also keeps a hash table from object pointer to index, updated by
+Alloc and Release, so that Table::Find takes constant time.  This is
+useful when an object being torn down must release its slot but did
+not remember its index.
 
 In later assignments, the Table class may be used to implement internal
 operating system tables of processes, threads, memory page frames, open
@@ -26,14 +48,22 @@ files, etc.
 
 */
 
+#ifndef TABLE_H
+#define TABLE_H
+
 #include "synch.h"
 // #include "synch-sleep.h"
 
+// Readers are only ever in the current or the previous epoch; a
+// power of two more than that lets the epoch wrap around.
+#define EpochBuckets 4
+
 
 class Table {
    public:
-     // create a table to hold at most 'size' entries.
-     Table(int size);
+     // create a table to hold at most 'size' entries.  If
+     // 'reverseIndex' is true, also support Find.
+     Table(int size, bool reverseIndex = false);
 
      // de-allocate Table when no longer needed.
      ~Table();
@@ -47,14 +77,69 @@ class Table {
      // and the pointer in place.
      void *Get(int index);
    
-     // free a table slot
+     // free a table slot.  The slot is not reused until all readers
+     // that are currently between BeginRead and EndRead have left.
      void Release(int index);
+
+     // return the index of a slot holding 'object', or -1 if there
+     // is none.  Only for tables created with a reverse index.
+     int Find(void *object);
+
+     // enter a read-side critical section, during which no released
+     // slot will be reused.  Return the epoch to pass to EndRead.
+     int BeginRead();
+
+     // leave the read-side critical section entered in 'readEpoch'.
+     void EndRead(int readEpoch);
+
+     // return how many calls to Alloc failed, how many had to wait
+     // for the table lock, and for how many ticks in all.
+     int Failures();
+     int LockWaits();
+     int LockWaitTicks();
+
+     // print occupancy and lock contention statistics.
+     void PrintStats();
+
+     // print the statistics of every Table still allocated
+     // (for use at Cleanup).
+     static void PrintAllStats();
    private:
      // Your code here.
      int size;
      Lock* lock;
      void** elem;
 
-     
+     unsigned epoch;         // current global epoch
+     int readers[EpochBuckets];  // readers inside BeginRead/EndRead,
+                             // by the epoch they entered in (mod 4)
+     unsigned *retired;      // epoch in which each slot was last released
+
+     void TryAdvance();      // move to the next epoch if no reader
+                             // is left in the previous one
+
+     int *byObject;          // reverse index: open-addressed hash
+                             // table of slot indices, keyed by the
+                             // object in the slot; -1 if empty, or
+                             // NULL if the table has no reverse index
+     int hashMask;           // hash table size - 1 (a power of two)
+
+     int Hash(void *object); // bucket in which to start looking
+     void AddToIndex(int index);      // maintain the reverse index
+     void RemoveFromIndex(int index);
+
+     // statistics, printed by PrintStats
+     int inUse;              // slots currently allocated
+     int highWater;          // most slots ever allocated at once
+     int numAllocs;          // calls to Alloc that found a slot
+     int numFailures;        // calls to Alloc that returned -1
+     int slotsScanned;       // slots examined by all calls to Alloc
+     int lockWaits;          // calls to Alloc that slept on TableLock
+     int lockWaitTicks;      // ticks they spent asleep
+     void AcquireLock();     // acquire TableLock, counting any wait
+
+     static Table *allTables;  // every Table allocated, for PrintAllStats
+     Table *nextTable;
 };
 
+#endif // TABLE_H
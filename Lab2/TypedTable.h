@@ -0,0 +1,168 @@
+// TypedTable.h
+//	A parameterized version of Table.
+//
+//	Table stores an untyped (void *) in each entry, so every Get
+//	costs a second memory reference into a separately allocated
+//	object, and every caller has to cast.  TypedTable<T> instead
+//	keeps the objects themselves in a contiguous array of slots:
+//	Alloc copy-constructs the object in place, Get returns a pointer
+//	into the slot, and Release destroys the object.  A lookup
+//	touches a single slot.
+//
+//	This only makes sense for small objects.  For large ones, or for
+//	objects that must outlive their table entry, use TypedTable<T *>;
+//	that specialization stores just the pointer, exactly as Table does,
+//	but without the casts.
+//
+//	Since TypedTable is a template, all of its code lives in this file.
+//
+// Copyright (c) 2020 MarxYoung.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#ifndef TYPEDTABLE_H
+#define TYPEDTABLE_H
+
+#include "copyright.h"
+#include "synch.h"
+#include "Table.h"
+#include "AlignedStorage.h"
+
+#include <new>
+
+template <class T>
+class TypedTable {
+  public:
+    TypedTable(int tableSize);	// create a table to hold at most
+				// 'tableSize' objects
+    ~TypedTable();		// destroy any objects still in the table
+
+    int Alloc(const T &object);	// copy 'object' into a free slot; return
+				// the slot's index or -1 if the table is full
+    T *Get(int index);		// return the object in slot 'index', or
+				// NULL if the slot is free (assert index is
+				// in range)
+    void Release(int index);	// destroy the object and free the slot
+
+  private:
+    struct Slot {
+	AlignedStorage<T> storage;	// uninitialized storage for one T
+	bool inUse;		// is there a live T in 'storage'?
+
+	T *Object() { return storage.Object(); }
+    };
+
+    int size;
+    Lock *lock;			// serialize Alloc and Release
+    Slot *slots;
+    char *slotMemory;		// what 'slots' was carved out of
+};
+
+// TypedTable<T *> holds pointers to objects the caller owns.  It is
+// a thin typed wrapper around Table.
+
+template <class T>
+class TypedTable<T *> {
+  public:
+    TypedTable(int tableSize) { table = new Table(tableSize); }
+    ~TypedTable() { delete table; }
+
+    int Alloc(T *object) { return table->Alloc((void *) object); }
+    T *Get(int index) { return (T *) table->Get(index); }
+    void Release(int index) { table->Release(index); }
+
+  private:
+    Table *table;
+};
+
+//----------------------------------------------------------------------
+// TypedTable<T>::TypedTable
+// 	Create a table to hold at most 'tableSize' objects.  No objects
+//	are constructed until they are allocated.
+//----------------------------------------------------------------------
+
+template <class T>
+TypedTable<T>::TypedTable(int tableSize)
+{
+    size = tableSize;
+    slots = AlignedArray<Slot>(size, &slotMemory);
+    for (int i = 0; i < size; i++)
+	slots[i].inUse = false;
+    lock = new Lock("TypedTableLock");
+}
+
+//----------------------------------------------------------------------
+// TypedTable<T>::~TypedTable
+// 	Destroy the objects still allocated in the table, and
+//	de-allocate the table.
+//----------------------------------------------------------------------
+
+template <class T>
+TypedTable<T>::~TypedTable()
+{
+    for (int i = 0; i < size; i++)
+	if (slots[i].inUse)
+	    slots[i].Object()->~T();
+    delete [] slotMemory;
+    delete lock;
+}
+
+//----------------------------------------------------------------------
+// TypedTable<T>::Alloc
+// 	Copy-construct 'object' into the first free slot.
+//	Return the slot's index, or -1 if the table is full.
+//----------------------------------------------------------------------
+
+template <class T>
+int
+TypedTable<T>::Alloc(const T &object)
+{
+    int index = -1;
+
+    lock->Acquire();
+    for (int i = 0; i < size; i++) {
+	if (!slots[i].inUse) {
+	    new (slots[i].storage.bytes) T(object);
+	    slots[i].inUse = true;
+	    index = i;
+	    break;
+	}
+    }
+    lock->Release();
+    return index;
+}
+
+//----------------------------------------------------------------------
+// TypedTable<T>::Get
+// 	Return a pointer to the object in slot 'index', or NULL if
+//	the slot is free.  The pointer is only valid until the slot
+//	is released.
+//----------------------------------------------------------------------
+
+template <class T>
+T *
+TypedTable<T>::Get(int index)
+{
+    ASSERT(index >= 0 && index < size);
+    return slots[index].inUse ? slots[index].Object() : NULL;
+}
+
+//----------------------------------------------------------------------
+// TypedTable<T>::Release
+// 	Destroy the object in slot 'index' and make the slot free.
+//----------------------------------------------------------------------
+
+template <class T>
+void
+TypedTable<T>::Release(int index)
+{
+    ASSERT(index >= 0 && index < size);
+    lock->Acquire();
+    if (slots[index].inUse) {
+	slots[index].Object()->~T();
+	slots[index].inUse = false;
+    }
+    lock->Release();
+}
+
+#endif // TYPEDTABLE_H
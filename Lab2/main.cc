@@ -52,9 +52,11 @@
 
 #include "utility.h"
 #include "system.h"
+#include "Table.h"
 
 #ifdef THREADS
 extern int testnum;
+extern int benchReadBytes, benchWriteBytes, benchMaxCapacity;
 #endif
 
 // External functions used by this file
@@ -86,6 +88,8 @@ main(int argc, char **argv)
 
     DEBUG('t', "Entering main");
     (void) Initialize(argc, argv);
+    if (DebugIsEnabled('T'))	// Table occupancy and contention, printed
+	atexit(Table::PrintAllStats);	// when Cleanup exits
     
 #ifdef THREADS
 	int T = 0;	// number of threads
@@ -100,7 +104,8 @@ main(int argc, char **argv)
 			break;
 		}
         testnum = atoi(argv[1]);
-		if (testnum == 2 or testnum == 6) {
+		if (testnum == 2 or testnum == 6 or testnum == 11 or testnum == 13
+		    or (testnum >= 15 and testnum <= 19)) {
 			if (argc < 5) {
 				printf("too few parameters\n");
 				break;
@@ -111,7 +116,26 @@ main(int argc, char **argv)
 			RandomInit(unsigned(T * T + N * N));	// initialize pseudo-random
 			argCount += 3;
 		}
-		if (testnum == 4) {
+		if (testnum == 10) {	// -q 10 capacity readers writers
+					//	rbytes wbytes [maxcapacity]
+			if (argc < 7) {
+				printf("too few parameters\n");
+				break;
+			}
+			T = atoi(argv[2]);
+			N = atoi(argv[3]);
+			E = atoi(argv[4]);
+			benchReadBytes = atoi(argv[5]);
+			benchWriteBytes = atoi(argv[6]);
+			benchMaxCapacity = T;
+			argCount += 5;
+			if (argc > 7 && argv[7][0] != '-') {
+				benchMaxCapacity = atoi(argv[7]);
+				argCount++;
+			}
+		}
+		if (testnum == 4 or testnum == 12 or testnum == 14
+		    or testnum == 20) {
 			if (argc < 4) {
 				printf("too few parameters\n");
 				break;
@@ -31,13 +31,16 @@
 //
 //	"debugName" is an arbitrary name, useful for debugging.
 //	"initialValue" is the initial value of the semaphore.
+//	"handoffMode" is true if V() should hand its permit to a waiter.
 //----------------------------------------------------------------------
 
-Semaphore::Semaphore(char* debugName, int initialValue)
+Semaphore::Semaphore(char* debugName, int initialValue, bool handoffMode)
 {
     name = debugName;
     value = initialValue;
     queue = new List;
+    handoff = handoffMode;
+    numAcquires = numSleeps = numRequeues = 0;
 }
 
 //----------------------------------------------------------------------
@@ -59,20 +62,35 @@ Semaphore::~Semaphore()
 //
 //	Note that Thread::Sleep assumes that interrupts are disabled
 //	when it is called.
+//
+//	In handoff mode, a thread that had to sleep is only woken by a
+//	V() that gives it the permit, so it has nothing left to check.
 //----------------------------------------------------------------------
 
 void
 Semaphore::P()
 {
     IntStatus oldLevel = interrupt->SetLevel(IntOff);	// disable interrupts
-    
-    while (value == 0) { 			// semaphore not available
-	queue->Append((void *)currentThread);	// so go to sleep
+
+    numAcquires++;
+    if (handoff && value == 0) {		// V() will pass its value
+	queue->Append((void *)currentThread);	// straight to us
+	numSleeps++;
 	currentThread->Sleep();
-    } 
-    value--; 					// semaphore available, 
+    } else {
+	bool woken = false;
+	while (value == 0) { 			// semaphore not available
+	    if (woken)				// someone else got there first
+		numRequeues++;
+	    queue->Append((void *)currentThread);	// so go to sleep
+	    numSleeps++;
+	    currentThread->Sleep();
+	    woken = true;
+	}
+	value--; 				// semaphore available,
 						// consume its value
-    
+    }
+
     (void) interrupt->SetLevel(oldLevel);	// re-enable interrupts
 }
 
@@ -82,6 +100,9 @@ Semaphore::P()
 //	As with P(), this operation must be atomic, so we need to disable
 //	interrupts.  Scheduler::ReadyToRun() assumes that threads
 //	are disabled when it is called.
+//
+//	In handoff mode, if there is a waiter, the value is not
+//	incremented: the waiter takes the permit with it.
 //----------------------------------------------------------------------
 
 void
@@ -93,7 +114,8 @@ Semaphore::V()
     thread = (Thread *)queue->Remove();
     if (thread != NULL)	   // make thread ready, consuming the V immediately
 	scheduler->ReadyToRun(thread);
-    value++;
+    if (thread == NULL || !handoff)	// else the permit goes with it
+	value++;
     (void) interrupt->SetLevel(oldLevel);
 }
 
@@ -106,14 +128,15 @@ Semaphore::V()
 // 	Initialize a Lock.
 //
 //	"debugName" is an arbitrary name, useful for debugging.
+//	"handoffMode" is true if Release should hand the lock to a waiter.
 //----------------------------------------------------------------------
 
-Lock::Lock(char* debugName) 
+Lock::Lock(char* debugName, bool handoffMode)
 {
     name = debugName;
     isBusy = false;
     owner = NULL;
-    s = new Semaphore(debugName, 1);
+    s = new Semaphore(debugName, 1, handoffMode);
 }
 
 //----------------------------------------------------------------------
@@ -170,6 +193,137 @@ void Lock::Release()
     s->V();
 }
 
+//----------------------------------------------------------------------
+// RWLock::RWLock
+// 	Initialize a reader-writer lock, FREE.
+//
+//	"debugName" is an arbitrary name, useful for debugging.
+//	"preferWriters" is true if new readers should wait behind
+//	waiting writers.
+//----------------------------------------------------------------------
+
+RWLock::RWLock(char* debugName, bool preferWriters)
+{
+    name = debugName;
+    readers = 0;
+    writer = NULL;
+    writing = false;
+    writerPreference = preferWriters;
+    waitingReaders = waitingWriters = 0;
+    mutex = new Semaphore(debugName, 1);
+    readGate = new Semaphore(debugName, 0);
+    writeGate = new Semaphore(debugName, 0);
+}
+
+//----------------------------------------------------------------------
+// RWLock::~RWLock
+// 	De-allocate RWLock, when no longer needed.
+//----------------------------------------------------------------------
+
+RWLock::~RWLock()
+{
+    delete mutex;
+    delete readGate;
+    delete writeGate;
+}
+
+//----------------------------------------------------------------------
+// RWLock::isHeldExclusiveByCurrentThread
+// true if the current thread holds the lock exclusive.
+//----------------------------------------------------------------------
+
+bool RWLock::isHeldExclusiveByCurrentThread()
+{
+    return writer == currentThread;
+}
+
+//----------------------------------------------------------------------
+// RWLock::AcquireShared
+// wait until no thread holds the lock exclusive (and, with writer
+// preference, none is waiting to), then hold it shared
+// a thread that has to wait is counted in by the one that opens the
+// read gate for it
+//----------------------------------------------------------------------
+
+void RWLock::AcquireShared()
+{
+    ASSERT(!isHeldExclusiveByCurrentThread());
+    mutex->P();
+    if (writing || (writerPreference && waitingWriters > 0)) {
+        waitingReaders++;
+        mutex->V();
+        readGate->P();
+    } else {
+        readers++;
+        mutex->V();
+    }
+}
+
+//----------------------------------------------------------------------
+// RWLock::ReleaseShared
+// stop reading; the last reader out hands the lock to a waiting writer
+//----------------------------------------------------------------------
+
+void RWLock::ReleaseShared()
+{
+    mutex->P();
+    ASSERT(readers > 0);
+    if (--readers == 0 && waitingWriters > 0) {
+        waitingWriters--;
+        writing = true;
+        writeGate->V();
+    }
+    mutex->V();
+}
+
+//----------------------------------------------------------------------
+// RWLock::AcquireExclusive
+// wait until no thread holds the lock, then hold it exclusive
+// a thread that has to wait is marked writing by the one that opens
+// the write gate for it
+//----------------------------------------------------------------------
+
+void RWLock::AcquireExclusive()
+{
+    ASSERT(!isHeldExclusiveByCurrentThread());
+    mutex->P();
+    if (writing || readers > 0) {
+        waitingWriters++;
+        mutex->V();
+        writeGate->P();
+    } else {
+        writing = true;
+        mutex->V();
+    }
+    writer = currentThread;
+}
+
+//----------------------------------------------------------------------
+// RWLock::ReleaseExclusive
+// stop writing; hand the lock to the next writer if writers are
+// preferred (or no reader is waiting), else to all waiting readers
+//----------------------------------------------------------------------
+
+void RWLock::ReleaseExclusive()
+{
+    ASSERT(isHeldExclusiveByCurrentThread());
+    mutex->P();
+    writer = NULL;
+    writing = false;
+    if (waitingWriters > 0 && (writerPreference || waitingReaders == 0)) {
+        waitingWriters--;
+        writing = true;
+        writeGate->V();
+    } else {
+        while (waitingReaders > 0) {
+            waitingReaders--;
+            readers++;
+            readGate->V();
+        }
+    }
+    mutex->V();
+}
+
 //----------------------------------------------------------------------
 // Condition::Condition
 // 	Initialize a Condition
@@ -31,13 +31,16 @@
 //
 //	"debugName" is an arbitrary name, useful for debugging.
 //	"initialValue" is the initial value of the semaphore.
+//	"handoffMode" is true if V() should hand its permit to a waiter.
 //----------------------------------------------------------------------
 
-Semaphore::Semaphore(char* debugName, int initialValue)
+Semaphore::Semaphore(char* debugName, int initialValue, bool handoffMode)
 {
     name = debugName;
     value = initialValue;
     queue = new List;
+    handoff = handoffMode;
+    numAcquires = numSleeps = numRequeues = 0;
 }
 
 //----------------------------------------------------------------------
@@ -59,6 +62,9 @@ Semaphore::~Semaphore()
 //
 //	Note that Thread::Sleep assumes that interrupts are disabled
 //	when it is called.
+//
+//	In handoff mode, a thread that had to sleep is only woken by a
+//	V() that gives it the permit, so it has nothing left to check.
 //----------------------------------------------------------------------
 
 void
@@ -66,12 +72,24 @@ Semaphore::P()
 {
     IntStatus oldLevel = interrupt->SetLevel(IntOff);	// disable interrupts
 
-    while (value == 0) { 			// semaphore not available
-	queue->Append((void *)currentThread);	// so go to sleep
+    numAcquires++;
+    if (handoff && value == 0) {		// V() will pass its value
+	queue->Append((void *)currentThread);	// straight to us
+	numSleeps++;
 	currentThread->Sleep();
-    }
-    value--; 					// semaphore available,
+    } else {
+	bool woken = false;
+	while (value == 0) { 			// semaphore not available
+	    if (woken)				// someone else got there first
+		numRequeues++;
+	    queue->Append((void *)currentThread);	// so go to sleep
+	    numSleeps++;
+	    currentThread->Sleep();
+	    woken = true;
+	}
+	value--; 				// semaphore available,
 						// consume its value
+    }
 
     (void) interrupt->SetLevel(oldLevel);	// re-enable interrupts
 }
@@ -82,6 +100,9 @@ Semaphore::P()
 //	As with P(), this operation must be atomic, so we need to disable
 //	interrupts.  Scheduler::ReadyToRun() assumes that threads
 //	are disabled when it is called.
+//
+//	In handoff mode, if there is a waiter, the value is not
+//	incremented: the waiter takes the permit with it.
 //----------------------------------------------------------------------
 
 void
@@ -93,7 +114,8 @@ Semaphore::V()
     thread = (Thread *)queue->Remove();
     if (thread != NULL)	   // make thread ready, consuming the V immediately
 	scheduler->ReadyToRun(thread);
-    value++;
+    if (thread == NULL || !handoff)	// else the permit goes with it
+	value++;
     (void) interrupt->SetLevel(oldLevel);
 }
 
@@ -106,14 +128,17 @@ Semaphore::V()
 // 	Initialize a Lock.
 //
 //	"debugName" is an arbitrary name, useful for debugging.
+//	"handoffMode" is true if Release should hand the lock to a waiter.
 //----------------------------------------------------------------------
 
-Lock::Lock(char* debugName)
+Lock::Lock(char* debugName, bool handoffMode)
 {
     name = debugName;
     isBusy = false;     //lock is free
     queue = new List;
     owner = NULL;
+    handoff = handoffMode;
+    numAcquires = numSleeps = numRequeues = 0;
 }
 
 //----------------------------------------------------------------------
@@ -143,6 +168,7 @@ bool Lock::isHeldByCurrentThread()
 //----------------------------------------------------------------------
 // Lock::Acquire
 // wait until the lock is FREE, then set it to BUSY
+// in handoff mode, Release may have made us the owner while we slept
 //----------------------------------------------------------------------
 
 void Lock::Acquire()
@@ -152,10 +178,16 @@ void Lock::Acquire()
     
     IntStatus oldLevel = interrupt->SetLevel(IntOff);   // disable interrupts
 
-    while(isBusy) //if Lock is busy
+    numAcquires++;
+    bool woken = false;
+    while(isBusy && owner != currentThread) //if Lock is busy
     {
+        if(woken)   //another thread took the Lock before we ran
+            numRequeues++;
         queue->Append((void *) currentThread);  //so go to sleep
+        numSleeps++;
         currentThread->Sleep();
+        woken = true;
     }
     isBusy = true;  //set the Lock to busy
     owner = currentThread;
@@ -168,6 +200,8 @@ void Lock::Acquire()
 // release the lock
 // if any threads is waiting the Lock and current thread is the
 // owner of the Lock ,then wake up the first thread
+// in handoff mode, the Lock stays busy and the woken thread owns it,
+// so no other thread can take it before the woken one runs
 //----------------------------------------------------------------------
 
 void Lock::Release()
@@ -182,8 +216,173 @@ void Lock::Release()
     {
         scheduler->ReadyToRun(thread);
     }
-    isBusy = false;
-    owner = NULL;
+    if(thread != NULL && handoff)   //pass the Lock on
+    {
+        owner = thread;
+    }
+    else
+    {
+        isBusy = false;
+        owner = NULL;
+    }
+
+    (void) interrupt->SetLevel(oldLevel);   // re-enable interrupts
+}
+
+//----------------------------------------------------------------------
+// Lock::AddWaiter
+// put 'thread', which is asleep, on the queue of threads waiting for
+// the Lock, as if it had called Acquire; Release will wake it
+// the Lock must be held, so that there is a Release to come
+//----------------------------------------------------------------------
+
+void Lock::AddWaiter(Thread *thread)
+{
+    ASSERT(isBusy);
+    IntStatus oldLevel = interrupt->SetLevel(IntOff);   // disable interrupts
+
+    queue->Append((void *) thread);
+
+    (void) interrupt->SetLevel(oldLevel);   // re-enable interrupts
+}
+
+//----------------------------------------------------------------------
+// RWLock::RWLock
+// 	Initialize a reader-writer lock, FREE.
+//
+//	"debugName" is an arbitrary name, useful for debugging.
+//	"preferWriters" is true if new readers should wait behind
+//	waiting writers.
+//----------------------------------------------------------------------
+
+RWLock::RWLock(char* debugName, bool preferWriters)
+{
+    name = debugName;
+    readers = 0;
+    writer = NULL;
+    writerPreference = preferWriters;
+    readQueue = new List;
+    writeQueue = new List;
+}
+
+//----------------------------------------------------------------------
+// RWLock::~RWLock
+// 	De-allocate RWLock, when no longer needed.
+//----------------------------------------------------------------------
+
+RWLock::~RWLock()
+{
+    delete readQueue;
+    delete writeQueue;
+}
+
+//----------------------------------------------------------------------
+// RWLock::isHeldExclusiveByCurrentThread
+// true if the current thread holds the lock exclusive.
+//----------------------------------------------------------------------
+
+bool RWLock::isHeldExclusiveByCurrentThread()
+{
+    return writer == currentThread;
+}
+
+//----------------------------------------------------------------------
+// RWLock::AcquireShared
+// wait until no thread holds the lock exclusive (and, with writer
+// preference, none is waiting to), then hold it shared
+// a thread that had to wait is counted in by the one that wakes it
+//----------------------------------------------------------------------
+
+void RWLock::AcquireShared()
+{
+    ASSERT(!isHeldExclusiveByCurrentThread());
+    IntStatus oldLevel = interrupt->SetLevel(IntOff);   // disable interrupts
+
+    if(writer != NULL || (writerPreference && !writeQueue->IsEmpty()))
+    {
+        readQueue->Append((void *) currentThread);  //so go to sleep
+        currentThread->Sleep();
+    }
+    else
+        readers++;
+
+    (void) interrupt->SetLevel(oldLevel);   // re-enable interrupts
+}
+
+//----------------------------------------------------------------------
+// RWLock::ReleaseShared
+// stop reading; the last reader out hands the lock to a waiting writer
+//----------------------------------------------------------------------
+
+void RWLock::ReleaseShared()
+{
+    Thread* thread;
+    IntStatus oldLevel = interrupt->SetLevel(IntOff);   // disable interrupts
+
+    ASSERT(readers > 0);
+    if(--readers == 0)
+    {
+        thread = (Thread *)writeQueue->Remove();
+        if(thread != NULL)
+        {
+            writer = thread;
+            scheduler->ReadyToRun(thread);
+        }
+    }
+
+    (void) interrupt->SetLevel(oldLevel);   // re-enable interrupts
+}
+
+//----------------------------------------------------------------------
+// RWLock::AcquireExclusive
+// wait until no thread holds the lock, then hold it exclusive
+// a thread that had to wait is made the writer by the one that wakes it
+//----------------------------------------------------------------------
+
+void RWLock::AcquireExclusive()
+{
+    ASSERT(!isHeldExclusiveByCurrentThread());
+    IntStatus oldLevel = interrupt->SetLevel(IntOff);   // disable interrupts
+
+    if(writer != NULL || readers > 0)
+    {
+        writeQueue->Append((void *) currentThread);  //so go to sleep
+        currentThread->Sleep();
+    }
+    else
+        writer = currentThread;
+    ASSERT(writer == currentThread);
+
+    (void) interrupt->SetLevel(oldLevel);   // re-enable interrupts
+}
+
+//----------------------------------------------------------------------
+// RWLock::ReleaseExclusive
+// stop writing; hand the lock to the next writer if writers are
+// preferred (or no reader is waiting), else to all waiting readers
+//----------------------------------------------------------------------
+
+void RWLock::ReleaseExclusive()
+{
+    Thread* thread;
+    ASSERT(isHeldExclusiveByCurrentThread());
+    IntStatus oldLevel = interrupt->SetLevel(IntOff);   // disable interrupts
+
+    writer = NULL;
+    if(!writeQueue->IsEmpty() && (writerPreference || readQueue->IsEmpty()))
+    {
+        thread = (Thread *)writeQueue->Remove();
+        writer = thread;
+        scheduler->ReadyToRun(thread);
+    }
+    else
+    {
+        while((thread = (Thread *)readQueue->Remove()) != NULL)
+        {
+            readers++;
+            scheduler->ReadyToRun(thread);
+        }
+    }
 
     (void) interrupt->SetLevel(oldLevel);   // re-enable interrupts
 }
@@ -198,6 +397,7 @@ Condition::Condition(char* debugName)
 {
     name = debugName;
     queue = new List;
+    mutex = NULL;
 }
 
 //----------------------------------------------------------------------
@@ -214,6 +414,8 @@ Condition::~Condition()
 // Condition::Wait
 //  if thread is waiting condition variable, then release the Lock
 //  and reacquire the Lock
+//  Signal moves us to the Lock's queue, so we are only woken when
+//  the Lock is released; in handoff mode it is then already ours
 //----------------------------------------------------------------------
 
 void Condition::Wait(Lock* conditionLock)
@@ -229,14 +431,17 @@ void Condition::Wait(Lock* conditionLock)
     conditionLock->Release();
     queue->Append((void *)currentThread);
     currentThread->Sleep();
-    conditionLock->Acquire();
+    if (!conditionLock->isHeldByCurrentThread())
+        conditionLock->Acquire();
 
     (void) interrupt->SetLevel(oldLevel);   // re-enable interrupts
 }
 
 //----------------------------------------------------------------------
 // Condition::Signal
-//  if queue is not empty, then wake up the next thread
+//  if queue is not empty, then move the next thread to the queue of
+//  the Lock, which the current thread holds; it will be woken when
+//  the Lock is released
 //----------------------------------------------------------------------
 
 void Condition::Signal(Lock* conditionLock)
@@ -251,15 +456,16 @@ void Condition::Signal(Lock* conditionLock)
     IntStatus oldLevel = interrupt->SetLevel(IntOff);   // disable interrupts
 
     thread = (Thread *)queue->Remove();
-    if(thread != NULL)  //wake up the next thread
-        scheduler->ReadyToRun(thread);
+    if(thread != NULL)  //wait for the Lock instead
+        conditionLock->AddWaiter(thread);
 
     (void) interrupt->SetLevel(oldLevel);   // re-enable interrupts
 }
 
 //----------------------------------------------------------------------
 // Condition::Broadcast
-//  wake up all threads
+//  move all threads to the queue of the Lock, to be woken one at a
+//  time as it is released
 //----------------------------------------------------------------------
 
 void Condition::Broadcast(Lock* conditionLock)
@@ -269,16 +475,14 @@ void Condition::Broadcast(Lock* conditionLock)
     else
         ASSERT(mutex == conditionLock);
 
-    ASSERT(conditionLock->isHeldByCurrentThread());
-
     Thread* thread;
     ASSERT(conditionLock->isHeldByCurrentThread());
     IntStatus oldLevel = interrupt->SetLevel(IntOff);   // disable interrupts
 
     thread = (Thread *)queue->Remove();
-    while(thread != NULL)   //wake up all threads
+    while(thread != NULL)   //all wait for the Lock instead
     {
-        scheduler->ReadyToRun(thread);
+        conditionLock->AddWaiter(thread);
         thread = (Thread *)queue->Remove();
     }
 
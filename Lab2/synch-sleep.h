@@ -35,20 +35,39 @@
 // into a register, a context switch might have occurred,
 // and some other thread might have called P or V, so the true value might
 // now be different.
+//
+// A semaphore created with "handoffMode" true passes each V() straight to
+// the thread it wakes, instead of incrementing the value and leaving
+// the woken thread to race any other caller of P() for it.  Under
+// contention this saves the woken thread from going back to sleep
+// after its wasted wakeup; the cost is that a thread calling P() while
+// another is being woken up always waits its turn.
+//
+// Acquires() and Sleeps() count the calls to P(), and the times a
+// thread went to sleep in P(), since the semaphore was created;
+// Requeues() counts the wasted wakeups, after which a thread found
+// the value taken again and went back to sleep.
 
 class Semaphore {
   public:
-    Semaphore(char* debugName, int initialValue);	// set initial value
+    Semaphore(char* debugName, int initialValue,
+	      bool handoffMode = false);		// set initial value
     ~Semaphore();   					// de-allocate semaphore
     char* getName() { return name;}			// debugging assist
 
     void P();	 // these are the only operations on a semaphore
     void V();	 // they are both *atomic*
 
+    int Acquires() { return numAcquires; }	// calls to P()
+    int Sleeps() { return numSleeps; }		// waits in P()
+    int Requeues() { return numRequeues; }	// wasted wakeups in P()
+
   private:
     char* name;        // useful for debugging
     int value;         // semaphore value, always >= 0
     List *queue;       // threads waiting in P() for the value to be > 0
+    bool handoff;      // V() hands its permit to the thread it wakes
+    int numAcquires, numSleeps, numRequeues;
 };
 
 // The following class defines a "lock".  A lock can be BUSY or FREE.
@@ -62,10 +81,17 @@ class Semaphore {
 // In addition, by convention, only the thread that acquired the lock
 // may release it.  As with semaphores, you can't read the lock value
 // (because the value might change immediately after you read it).
+//
+// As for semaphores, a lock created with "handoffMode" true makes Release
+// pass the lock straight to the first waiting thread, which then owns
+// it before it even runs.  Acquires(), Sleeps() and Requeues() count
+// calls to Acquire, the times a thread slept in it, and the wakeups
+// after which it found the lock taken again.
 
 class Lock {
   public:
-    Lock(char* debugName);  		// initialize lock to be FREE
+    Lock(char* debugName, bool handoffMode = false);
+					// initialize lock to be FREE
     ~Lock();				// deallocate lock
     char* getName() { return name; }	// debugging assist
 
@@ -77,14 +103,70 @@ class Lock {
 					// checking in Release, and in
 					// Condition variable ops below.
 
+    int Acquires() { return numAcquires; }	// calls to Acquire
+    int Sleeps() { return numSleeps; }		// waits in Acquire
+    int Requeues() { return numRequeues; }	// wasted wakeups
+
   private:
+    friend class Condition;
+    void AddWaiter(Thread *thread);	// queue 'thread' as if it had
+					// blocked in Acquire
+
     char* name;				// for debugging
     bool isBusy;            //for busy flag
     List *queue;            //threads waiting in queue if Lock is busy
     Thread* owner;          //owner of the Lock
+    bool handoff;           //Release hands the Lock to the next waiter
+    int numAcquires, numSleeps, numRequeues;
     // plus some other stuff you'll need to define
 };
 
+// The following class defines a "reader-writer lock".  Any number of
+// threads may hold it shared, to read, or one thread may hold it
+// exclusive, to write:
+//
+//	AcquireShared -- wait until no thread holds the lock exclusive,
+//		then hold it shared
+//
+//	AcquireExclusive -- wait until no thread holds the lock at all,
+//		then hold it exclusive
+//
+//	ReleaseShared, ReleaseExclusive -- let go, waking up waiting
+//		threads that may now go ahead
+//
+// By default readers keep coming in while a writer waits, which is
+// best for read-mostly data but can starve writers.  A lock created
+// with "preferWriters" true makes new readers wait behind any
+// waiting writer instead.
+//
+// The lock is handed over on release: the releasing thread admits
+// the threads it wakes, so they never find it taken again when they
+// run.
+
+class RWLock {
+  public:
+    RWLock(char* debugName, bool preferWriters = false);
+					// initialize lock to be FREE
+    ~RWLock();				// deallocate lock
+    char* getName() { return name; }	// debugging assist
+
+    void AcquireShared();
+    void ReleaseShared();
+    void AcquireExclusive();
+    void ReleaseExclusive();
+
+    bool isHeldExclusiveByCurrentThread();	// true if the current
+						// thread holds it to write
+
+  private:
+    char* name;				// for debugging
+    int readers;			// threads holding the lock shared
+    Thread *writer;			// thread holding it exclusive, or NULL
+    bool writerPreference;
+    List *readQueue;			// threads waiting in AcquireShared
+    List *writeQueue;			// threads waiting in AcquireExclusive
+};
+
 // The following class defines a "condition variable".  A condition
 // variable does not have a value, but threads may be queued, waiting
 // on the variable.  These are only operations on a condition variable:
@@ -116,6 +198,13 @@ class Lock {
 // The consequence of using Mesa-style semantics is that some other thread
 // can acquire the lock, and change data structures, before the woken
 // thread gets a chance to run.
+//
+// Since the signaller still holds the lock, a thread made ready by
+// Signal would only run to find the lock busy and go back to sleep in
+// Acquire.  So Signal and Broadcast instead move the woken threads
+// straight onto the lock's queue ("wait morphing"): each becomes ready
+// only when the lock is released, and a Broadcast hands the lock to
+// the waiters one at a time rather than waking them all at once.
 
 class Condition {
   public:
@@ -15,6 +15,22 @@
 #include "synch.h"
 #include "Table.h"
 #include "BoundedBuffer.h"
+#include "Pipeline.h"
+#include "AdaptiveLock.h"
+#include "SPSCBuffer.h"
+#include "MPMCBuffer.h"
+#include "BroadcastBuffer.h"
+#include "PriorityBuffer.h"
+#include "SharedBoundedBuffer.h"
+#include "StaticBoundedBuffer.h"
+#include "TypedTable.h"
+
+#include <string.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include <unistd.h>
 
 extern void GenerateN(int N, DLList *list);
 extern void RemoveN(int N, DLList *list);
@@ -22,6 +38,7 @@ extern void RemoveN(int N, DLList *list);
 // testnum is set in main.cc
 int testnum = 1;
 int T, N, E;
+int benchReadBytes, benchWriteBytes, benchMaxCapacity;  // set in main.cc
 DLList *list;
 Lock *lock;
 Condition *cond;
@@ -293,8 +310,10 @@ TableActions(int which)
     }
     //
     for(int i =0; i < N; i++) {
+        int epoch = table->BeginRead();    // slot can't be recycled under us
         printf("*** thread %d gets %d from [%d] ***\n", which, (int)table->Get(indexArr[i]), indexArr[i]);
         currentThread->Yield();
+        table->EndRead(epoch);
     }
     //
     for(int i =0; i < N; i++) {
@@ -327,14 +346,14 @@ TableTest()
 //----------------------------------------------------------------------
 //WriteBuffer
 //	Create an pointer named 'data' that points to an area with 
-//'num' pieces of data and write these data to the buffer.
+//'num' bytes of data and write these data to the buffer.
 //----------------------------------------------------------------------
 
 void 
 WriteBuffer(int num)
 {   
     printf("\nCurrent thread is write thread :%s\n", currentThread -> getName());
-    int data[num];
+    char data[num];
     int i;
     for(i = 0; i<num; i++)
     {
@@ -359,7 +378,7 @@ void
 ReadBuffer(int num)
 {
     printf("\nCurrent thread is read thread :%s\n",currentThread -> getName());
-    int data[num + 1];
+    char data[num + 1];
     buffer -> Read((void *)data,num);
     printf("%s finished,read these data from buffer:",currentThread -> getName());
     int i;
@@ -440,37 +459,2135 @@ BufferTest()
 
 
 //----------------------------------------------------------------------
-// ThreadTest
-// 	Invoke a test routine.
+//BenchRead, BenchWrite
+//	Bodies of the benchmark threads: read (write) 'ops' times
+//  'benchReadBytes' ('benchWriteBytes') bytes, without printing,
+//  then tell the main thread we are done.
+//----------------------------------------------------------------------
+static Semaphore *benchDone;
+
+static void
+BenchRead(int ops)
+{
+    char *data = new char[benchReadBytes];
+    for (int i = 0; i < ops; i++)
+        buffer->Read(data, benchReadBytes);
+    delete [] data;
+    benchDone->V();
+}
+
+static void
+BenchWrite(int ops)
+{
+    char *data = new char[benchWriteBytes];
+    memset(data, 0, benchWriteBytes);
+    for (int i = 0; i < ops; i++)
+        buffer->Write(data, benchWriteBytes);
+    delete [] data;
+    benchDone->V();
+}
+
+//----------------------------------------------------------------------
+//BufferBenchmark
+//	Measure BoundedBuffer throughput, without any printing on the way.
+//  T:capacity of the buffer
+//  N:num of read threads, each reading benchReadBytes at a time
+//  E:num of write threads, each writing benchWriteBytes at a time
+//  If benchMaxCapacity is more than T, repeat with capacity 2T, 4T, ...
+//  up to benchMaxCapacity, to chart throughput against buffer size.
+//
+//  The total moved is the smallest multiple of both N * benchReadBytes
+//  and E * benchWriteBytes that is at least BenchBytes, so every thread
+//  does a whole number of operations.  Report bytes per second of host
+//  time, simulated ticks per byte, and the number of times a thread
+//  had to wait in the buffer (see BoundedBuffer::Waits).
 //----------------------------------------------------------------------
+#define BenchBytes (1 << 20)
+
+static int
+Gcd(int a, int b)
+{
+    while (b != 0) {
+        int r = a % b;
+        a = b;
+        b = r;
+    }
+    return a;
+}
 
 void
-ThreadTest(int t, int n, int e)
+BufferBenchmark()
 {
-    switch (testnum) {
-    case 1:
-        ThreadTest1();
-        break;
-    case 2:
-        T = t;
-        N = n;
-        E = e;
-        ThreadTest2();
-        break;
-    // test Lock and Condition
-    case 3:
-        ThreadTest3();
-        break;
-    case 4:
-        T = t;
-        N = n;
-        TableTest();
-        break;
-    case 6:
-        T = t;
-        N = n;
-        E = e;
-        BufferTest();
+    DEBUG('t', "Entering BufferBenchmark");
+    ASSERT(T > 0 && N > 0 && E > 0 && benchReadBytes > 0 && benchWriteBytes > 0);
+
+    int perRound = N * benchReadBytes;
+    int perRoundW = E * benchWriteBytes;
+    int unit = perRound / Gcd(perRound, perRoundW) * perRoundW;
+    int total = (BenchBytes + unit - 1) / unit * unit;
+    benchDone = new Semaphore("benchDone", 0);
+
+    printf("%d readers x %d bytes, %d writers x %d bytes, %d bytes in all\n",
+           N, benchReadBytes, E, benchWriteBytes, total);
+    for (int capacity = T; capacity <= benchMaxCapacity || capacity == T;
+         capacity *= 2) {
+        struct timeval start, end;
+        buffer = new BoundedBuffer(capacity);
+        int startTicks = stats->totalTicks;
+        gettimeofday(&start, NULL);
+
+        for (int i = 0; i < N; i++) {
+            Thread *t = new Thread("bench reader");
+            t->Fork(BenchRead, total / N / benchReadBytes);
+        }
+        for (int i = 0; i < E; i++) {
+            Thread *t = new Thread("bench writer");
+            t->Fork(BenchWrite, total / E / benchWriteBytes);
+        }
+        for (int i = 0; i < N + E; i++)
+            benchDone->P();
+
+        gettimeofday(&end, NULL);
+        int ticks = stats->totalTicks - startTicks;
+        double seconds = (end.tv_sec - start.tv_sec)
+                         + (end.tv_usec - start.tv_usec) / 1e6;
+        printf("capacity %8d: %12.0f bytes/sec, %8.3f ticks/byte, "
+               "%8d waits\n", capacity,
+               seconds > 0 ? total / seconds : 0.0,
+               (double)ticks / total, buffer->Waits());
+        delete buffer;
+    }
+    delete benchDone;
+}
+
+//----------------------------------------------------------------------
+//FeedPipeline
+//	Put the numbers 1..T into a pipeline, then close it.
+//----------------------------------------------------------------------
+static void
+FeedPipeline(int arg)
+{
+    Pipeline *pipeline = (Pipeline *)arg;
+    for (int i = 1; i <= T; i++)
+        pipeline->Put((void *)i);
+    pipeline->Close();
+}
+
+//----------------------------------------------------------------------
+//Square, SkipEven, AddOne
+//	Stage functions for PipelineTest.  Items are small integers
+//  passed as pointers; SkipEven drops the even ones.
+//----------------------------------------------------------------------
+static void *
+Square(void *item)
+{
+    return (void *)((int)item * (int)item);
+}
+
+static void *
+SkipEven(void *item)
+{
+    return ((int)item % 2 == 0) ? NULL : item;
+}
+
+static void *
+AddOne(void *item)
+{
+    return (void *)((int)item + 1);
+}
+
+//----------------------------------------------------------------------
+//PipelineTest
+//	Push the numbers 1..T through a three-stage pipeline: square,
+//  drop the even results, add one.  N is the number of threads in
+//  the middle stage, and E the number of items each buffer holds.
+//  Check the sum of the results and print the per-stage statistics.
+//----------------------------------------------------------------------
+void
+PipelineTest()
+{
+    DEBUG('t', "Entering PipelineTest");
+
+    Pipeline *pipeline = new Pipeline(E);
+    pipeline->AddStage("square", Square, 1, E);
+    pipeline->AddStage("skip even", SkipEven, N, E);
+    pipeline->AddStage("add one", AddOne, 1, E);
+    pipeline->Start(E);
+
+    int expected = 0;
+    for (int i = 1; i <= T; i++)
+        if (i % 2 == 1)
+            expected += i * i + 1;
+
+    // feed it from a thread of its own, so we can take the results here
+    Thread *t = new Thread("pipeline feeder");
+    t->Fork(FeedPipeline, (int)pipeline);
+
+    int sum = 0, count = 0;
+    void *item;
+    while ((item = pipeline->Get()) != NULL) {
+        sum += (int)item;
+        count++;
+    }
+    printf("*** %d results, sum %d (expected %d) ***\n", count, sum, expected);
+    pipeline->PrintStats();
+}
+
+//----------------------------------------------------------------------
+//LockContender
+//	Body of the LockBenchmark threads: take the lock (or the semaphore,
+//  used as a lock) 'ops' times, yielding once while holding it, so
+//  that the others pile up behind it, and up to twice more after
+//  releasing it, so that a thread may come back for the lock while
+//  the one it woke is still waiting to run.
+//----------------------------------------------------------------------
+static Lock *benchLock;
+static Semaphore *benchMutex;
+
+static void
+LockContender(int ops)
+{
+    for (int i = 0; i < ops; i++) {
+        if (benchLock != NULL)
+            benchLock->Acquire();
+        else
+            benchMutex->P();
+        currentThread->Yield();
+        if (benchLock != NULL)
+            benchLock->Release();
+        else
+            benchMutex->V();
+        for (int j = Random() % 3; j > 0; j--)
+            currentThread->Yield();
+    }
+    benchDone->V();
+}
+
+//----------------------------------------------------------------------
+//LockBenchmark
+//	Count how often threads contending for a Lock, and for a
+//  Semaphore used as a lock, go to sleep per acquisition, with and
+//  without handoff.  Without it, a woken thread may find the lock
+//  taken again by a thread that got to it first, and sleep again;
+//  these wasted wakeups are counted too.
+//  T:num of threads
+//  N:num of acquisitions per thread
+//----------------------------------------------------------------------
+void
+LockBenchmark()
+{
+    DEBUG('t', "Entering LockBenchmark");
+    ASSERT(T > 0 && N > 0);
+
+    benchDone = new Semaphore("benchDone", 0);
+    printf("%d threads x %d acquisitions\n", T, N);
+    for (int run = 0; run < 4; run++) {
+        bool handoff = (run % 2 == 1);
+        int acquires, sleeps, requeues;
+        int startTicks = stats->totalTicks;
+
+        benchLock = NULL;
+        benchMutex = NULL;
+        if (run < 2)
+            benchLock = new Lock("bench lock", handoff);
+        else
+            benchMutex = new Semaphore("bench mutex", 1, handoff);
+        for (int i = 0; i < T; i++) {
+            Thread *t = new Thread("lock contender");
+            t->Fork(LockContender, N);
+        }
+        for (int i = 0; i < T; i++)
+            benchDone->P();
+
+        if (benchLock != NULL) {
+            acquires = benchLock->Acquires();
+            sleeps = benchLock->Sleeps();
+            requeues = benchLock->Requeues();
+            delete benchLock;
+        } else {
+            acquires = benchMutex->Acquires();
+            sleeps = benchMutex->Sleeps();
+            requeues = benchMutex->Requeues();
+            delete benchMutex;
+        }
+        printf("%-9s %-7s: %7d acquires, %7d sleeps, %6.3f sleeps/acquire, "
+               "%6d wasted wakeups, %8d ticks\n",
+               run < 2 ? "Lock" : "Semaphore", handoff ? "handoff" : "barging",
+               acquires, sleeps, (double)sleeps / acquires, requeues,
+               stats->totalTicks - startTicks);
+    }
+    delete benchDone;
+}
+
+//----------------------------------------------------------------------
+//RWReader, RWWriter
+//	Bodies of the RWLockTest threads: hold the lock shared (exclusive)
+//  E times, yielding while holding it, and check that no writer is
+//  ever in with anyone else.  Writers record the longest they waited.
+//----------------------------------------------------------------------
+static RWLock *rwLock;
+static int rwReaders, rwWriters, rwMaxReaders, rwMaxWait;
+
+static void
+RWReader(int rounds)
+{
+    for (int i = 0; i < rounds; i++) {
+        rwLock->AcquireShared();
+        ASSERT(rwWriters == 0);
+        if (++rwReaders > rwMaxReaders)
+            rwMaxReaders = rwReaders;
+        currentThread->Yield();
+        rwReaders--;
+        rwLock->ReleaseShared();
+        for (int j = Random() % 3; j > 0; j--)
+            currentThread->Yield();
+    }
+    benchDone->V();
+}
+
+static void
+RWWriter(int rounds)
+{
+    for (int i = 0; i < rounds; i++) {
+        int start = stats->totalTicks;
+        rwLock->AcquireExclusive();
+        if (stats->totalTicks - start > rwMaxWait)
+            rwMaxWait = stats->totalTicks - start;
+        ASSERT(rwReaders == 0 && rwWriters == 0);
+        rwWriters++;
+        currentThread->Yield();
+        rwWriters--;
+        rwLock->ReleaseExclusive();
+        for (int j = Random() % 3; j > 0; j--)
+            currentThread->Yield();
+    }
+    benchDone->V();
+}
+
+//----------------------------------------------------------------------
+//RWLockTest
+//	Run readers and writers against an RWLock, first preferring
+//  readers, then writers, and print how many readers were in at once
+//  and how long a writer had to wait.
+//  T:num of reader threads
+//  N:num of writer threads
+//  E:times each thread takes the lock
+//----------------------------------------------------------------------
+void
+RWLockTest()
+{
+    DEBUG('t', "Entering RWLockTest");
+    ASSERT(T >= 0 && N >= 0 && E > 0);
+
+    benchDone = new Semaphore("benchDone", 0);
+    for (int run = 0; run < 2; run++) {
+        bool writerPreference = (run == 1);
+
+        rwLock = new RWLock("rw lock", writerPreference);
+        rwReaders = rwWriters = rwMaxReaders = rwMaxWait = 0;
+        for (int i = 0; i < T; i++) {
+            Thread *t = new Thread("rw reader");
+            t->Fork(RWReader, E);
+        }
+        for (int i = 0; i < N; i++) {
+            Thread *t = new Thread("rw writer");
+            t->Fork(RWWriter, E);
+        }
+        for (int i = 0; i < T + N; i++)
+            benchDone->P();
+        printf("%s preference: up to %d readers at once, "
+               "a writer waited up to %d ticks\n",
+               writerPreference ? "writer" : "reader", rwMaxReaders, rwMaxWait);
+        delete rwLock;
+    }
+    delete benchDone;
+}
+
+//----------------------------------------------------------------------
+//AdaptiveContender
+//	Body of the AdaptiveLockBenchmark threads: take the lock 'ops'
+//  times to bump a counter, yielding while holding it if the hold is
+//  meant to be long, and now and then after releasing it.
+//----------------------------------------------------------------------
+static AdaptiveLock *benchAdaptive;
+static bool benchLongHold;
+static int benchCounter;
+
+static void
+AdaptiveContender(int ops)
+{
+    for (int i = 0; i < ops; i++) {
+        if (benchAdaptive != NULL)
+            benchAdaptive->Acquire();
+        else
+            benchLock->Acquire();
+        benchCounter++;
+        if (benchLongHold)
+            currentThread->Yield();
+        if (benchAdaptive != NULL)
+            benchAdaptive->Release();
+        else
+            benchLock->Release();
+        for (int j = Random() % 3; j > 0; j--)
+            currentThread->Yield();
+    }
+    benchDone->V();
+}
+
+//----------------------------------------------------------------------
+//AdaptiveLockBenchmark
+//	Compare the blocking Lock with the AdaptiveLock, for short holds
+//  and for holds that yield the CPU, in host time, simulated ticks
+//  and sleeps.  Short holds show what the AdaptiveLock's atomic fast
+//  path saves, long ones what its sleeping through a Lock costs.
+//  T:num of threads
+//  N:num of acquisitions per thread
+//----------------------------------------------------------------------
+void
+AdaptiveLockBenchmark()
+{
+    DEBUG('t', "Entering AdaptiveLockBenchmark");
+    ASSERT(T > 0 && N > 0);
+
+    benchDone = new Semaphore("benchDone", 0);
+    printf("%d threads x %d acquisitions\n", T, N);
+    for (int run = 0; run < 4; run++) {
+        struct timeval start, end;
+        int sleeps;
+        int startTicks = stats->totalTicks;
+
+        benchLongHold = (run >= 2);
+        benchLock = NULL;
+        benchAdaptive = NULL;
+        if (run % 2 == 0)
+            benchLock = new Lock("bench lock");
+        else
+            benchAdaptive = new AdaptiveLock("bench adaptive lock");
+        benchCounter = 0;
+        gettimeofday(&start, NULL);
+        for (int i = 0; i < T; i++) {
+            Thread *t = new Thread("lock contender");
+            t->Fork(AdaptiveContender, N);
+        }
+        for (int i = 0; i < T; i++)
+            benchDone->P();
+        gettimeofday(&end, NULL);
+        ASSERT(benchCounter == T * N);
+
+        if (benchLock != NULL) {
+            sleeps = benchLock->Sleeps();
+            delete benchLock;
+        } else {
+            sleeps = benchAdaptive->Sleeps();
+            delete benchAdaptive;
+        }
+        printf("%-8s %-5s hold: %8ld usec, %8d ticks, %7d sleeps\n",
+               run % 2 == 0 ? "Lock" : "Adaptive",
+               benchLongHold ? "long" : "short",
+               (end.tv_sec - start.tv_sec) * 1000000L
+               + (end.tv_usec - start.tv_usec),
+               stats->totalTicks - startTicks, sleeps);
+    }
+    delete benchDone;
+}
+
+//----------------------------------------------------------------------
+//StreamByte
+//	The i'th byte of the stream the buffer tests send and check: 251
+//  is prime, so a byte lost or repeated anywhere shifts the pattern.
+//----------------------------------------------------------------------
+static inline char
+StreamByte(int i)
+{
+    return (char)(i % 251);
+}
+
+//----------------------------------------------------------------------
+//SPSCWriter, SPSCReader
+//	Bodies of the SPSCTest threads: send (receive and check) 'total'
+//  bytes of the stream, in chunks of 1 to E bytes.
+//----------------------------------------------------------------------
+static SPSCBuffer *spscBuffer;
+static int streamErrors;
+
+static void
+SPSCWriter(int total)
+{
+    char *data = new char[E];
+    for (int done = 0; done < total; ) {
+        int n = 1 + Random() % E;
+        if (n > total - done)
+            n = total - done;
+        for (int i = 0; i < n; i++)
+            data[i] = StreamByte(done + i);
+        spscBuffer->Write(data, n);
+        done += n;
+    }
+    delete [] data;
+    benchDone->V();
+}
+
+static void
+SPSCReader(int total)
+{
+    char *data = new char[E];
+    for (int done = 0; done < total; ) {
+        int n = 1 + Random() % E;
+        if (n > total - done)
+            n = total - done;
+        spscBuffer->Read(data, n);
+        for (int i = 0; i < n; i++)
+            if (data[i] != StreamByte(done + i))
+                streamErrors++;
+        done += n;
+    }
+    delete [] data;
+    benchDone->V();
+}
+
+//----------------------------------------------------------------------
+//SPSCTest
+//	Send a stream of bytes from one writer thread to one reader
+//  thread through an SPSCBuffer, and check that it arrives intact.
+//  T:capacity of the buffer
+//  N:num of bytes to send
+//  E:largest chunk read or written at a time
+//----------------------------------------------------------------------
+void
+SPSCTest()
+{
+    DEBUG('t', "Entering SPSCTest");
+    ASSERT(T > 0 && N > 0 && E > 0);
+
+    spscBuffer = new SPSCBuffer(T);
+    benchDone = new Semaphore("benchDone", 0);
+    streamErrors = 0;
+    Thread *t = new Thread("spsc writer");
+    t->Fork(SPSCWriter, N);
+    t = new Thread("spsc reader");
+    t->Fork(SPSCReader, N);
+    benchDone->P();
+    benchDone->P();
+    printf("*** SPSC: %d bytes, %d wrong ***\n", N, streamErrors);
+    delete benchDone;
+    delete spscBuffer;
+}
+
+//----------------------------------------------------------------------
+//MPMCProducer, MPMCConsumer
+//	Bodies of the MPMCTest threads.  Elements are ints: producer p
+//  sends p * MPMCItems + 0, 1, 2, ...; each consumer takes its share,
+//  marks each element seen, and checks that the elements of any one
+//  producer reach it in the order they were sent.
+//----------------------------------------------------------------------
+#define MPMCItems 300		// per producer; a multiple of the consumers
+static MPMCBuffer *mpmcBuffer;
+static char *mpmcSeen;
+
+static void
+MPMCProducer(int p)
+{
+    int items[4];
+
+    for (int i = 0; i < MPMCItems; ) {
+        int n = 1 + Random() % 4;
+        if (n > MPMCItems - i)
+            n = MPMCItems - i;
+        for (int j = 0; j < n; j++)
+            items[j] = p * MPMCItems + i + j;
+        mpmcBuffer->Write(items, n * sizeof(int));
+        i += n;
+    }
+    benchDone->V();
+}
+
+static void
+MPMCConsumer(int count)
+{
+    int *last = new int[N];		// last element seen from each producer
+
+    for (int p = 0; p < N; p++)
+        last[p] = -1;
+    for (int i = 0; i < count; i++) {
+        int item;
+        mpmcBuffer->Read(&item, sizeof(int));
+        if (item < 0 || item >= N * MPMCItems) {
+            streamErrors++;
+            continue;
+        }
+        mpmcSeen[item]++;
+        if (item % MPMCItems <= last[item / MPMCItems])
+            streamErrors++;
+        last[item / MPMCItems] = item % MPMCItems;
+    }
+    delete [] last;
+    benchDone->V();
+}
+
+//----------------------------------------------------------------------
+//MPMCTest
+//	Run several producers and consumers over one MPMCBuffer of ints,
+//  and check that every element is delivered exactly once.
+//  T:capacity of the buffer, in elements
+//  N:num of producer threads
+//  E:num of consumer threads (MPMCItems must be a multiple of it)
+//----------------------------------------------------------------------
+void
+MPMCTest()
+{
+    DEBUG('t', "Entering MPMCTest");
+    ASSERT(T > 0 && N > 0 && E > 0 && MPMCItems % E == 0);
+
+    mpmcBuffer = new MPMCBuffer(T, sizeof(int));
+    mpmcSeen = new char[N * MPMCItems];
+    memset(mpmcSeen, 0, N * MPMCItems);
+    benchDone = new Semaphore("benchDone", 0);
+    streamErrors = 0;
+    for (int i = 0; i < E; i++) {
+        Thread *t = new Thread("mpmc consumer");
+        t->Fork(MPMCConsumer, N * MPMCItems / E);
+    }
+    for (int i = 0; i < N; i++) {
+        Thread *t = new Thread("mpmc producer");
+        t->Fork(MPMCProducer, i);
+    }
+    for (int i = 0; i < N + E; i++)
+        benchDone->P();
+
+    int missing = 0, repeated = 0;
+    for (int i = 0; i < N * MPMCItems; i++) {
+        if (mpmcSeen[i] == 0)
+            missing++;
+        else if (mpmcSeen[i] > 1)
+            repeated++;
+    }
+    printf("*** MPMC: %d elements, %d missing, %d repeated, %d out of "
+           "order or bad ***\n", N * MPMCItems, missing, repeated,
+           streamErrors);
+    delete benchDone;
+    delete [] mpmcSeen;
+    delete mpmcBuffer;
+}
+
+//----------------------------------------------------------------------
+//BroadcastReader
+//	Body of the BroadcastTest consumers: read and check E bytes of
+//  the stream, in chunks of up to 64, as consumer 'id'.  The last
+//  consumer stops half way and removes itself, which must not hold
+//  up the writer.
+//----------------------------------------------------------------------
+static BroadcastBuffer *bcastBuffer;
+static int bcastLeaver;
+
+static void
+BroadcastReader(int id)
+{
+    char data[64];
+    int total = (id == bcastLeaver) ? E / 2 : E;
+
+    for (int done = 0; done < total; ) {
+        int n = 1 + Random() % 64;
+        if (n > total - done)
+            n = total - done;
+        bcastBuffer->Read(id, data, n);
+        for (int i = 0; i < n; i++)
+            if (data[i] != StreamByte(done + i))
+                streamErrors++;
+        done += n;
+    }
+    if (id == bcastLeaver)
+        bcastBuffer->RemoveConsumer(id);
+    benchDone->V();
+}
+
+//----------------------------------------------------------------------
+//BroadcastTest
+//	Write a stream of bytes into a BroadcastBuffer with several
+//  consumers, and check that each of them gets all of it.
+//  T:capacity of the buffer
+//  N:num of consumers (with more than one, the last leaves early)
+//  E:num of bytes to send
+//----------------------------------------------------------------------
+void
+BroadcastTest()
+{
+    DEBUG('t', "Entering BroadcastTest");
+    ASSERT(T > 0 && N > 0 && E > 0);
+
+    bcastBuffer = new BroadcastBuffer(T, N);
+    benchDone = new Semaphore("benchDone", 0);
+    streamErrors = 0;
+    bcastLeaver = -1;
+    for (int i = 0; i < N; i++) {
+        int id = bcastBuffer->AddConsumer();	// all before the writer
+        ASSERT(id >= 0);
+        if (N > 1 && i == N - 1)
+            bcastLeaver = id;
+        Thread *t = new Thread("broadcast reader");
+        t->Fork(BroadcastReader, id);
+    }
+    char *data = new char[E];
+    for (int i = 0; i < E; i++)
+        data[i] = StreamByte(i);
+    for (int done = 0; done < E; ) {
+        int n = 1 + Random() % 100;
+        if (n > E - done)
+            n = E - done;
+        bcastBuffer->Write(data + done, n);
+        done += n;
+    }
+    for (int i = 0; i < N; i++)
+        benchDone->P();
+    printf("*** Broadcast: %d bytes to %d consumers, %d wrong ***\n",
+           E, N, streamErrors);
+    delete [] data;
+    delete benchDone;
+    delete bcastBuffer;
+}
+
+//----------------------------------------------------------------------
+//PriorityBulkWriter, PriorityControlWriter
+//	Bodies of the PriorityTest writers.  The bulk writer sends 2 * T
+//  bytes to the least urgent lane a byte at a time, so the test can
+//  see how far it got before the buffer stopped it; the control
+//  writer sends E bytes to lane 0.
+//----------------------------------------------------------------------
+static PriorityBuffer *prioBuffer;
+static int prioBulkDone;
+static bool prioControlDone;
+
+static void
+PriorityBulkWriter(int lane)
+{
+    for (int i = 0; i < 2 * T; i++) {
+        char c = StreamByte(i);
+        prioBuffer->Write(lane, &c, 1);
+        prioBulkDone++;
+    }
+    benchDone->V();
+}
+
+static void
+PriorityControlWriter(int dummy)
+{
+    char *data = new char[E];
+    memset(data, 0, E);
+    prioBuffer->Write(0, data, E);
+    prioControlDone = TRUE;
+    delete [] data;
+    benchDone->V();
+}
+
+//----------------------------------------------------------------------
+//PriorityTest
+//	Test PriorityBuffer.  T is the capacity, N the number of lanes
+//  (at least 2), E the reserve of lane 0 (less than T).
+//
+//  First each lane, least urgent first, gets T / N bytes holding its
+//  own number; reads must then return them lane 0 first.  Then lane 0
+//  is given its reserve, and a bulk writer fills the last lane: it
+//  must stop after T - E bytes, and a write of E bytes to lane 0 must
+//  still go through.  Reading must then return the control bytes
+//  first, and the bulk bytes in order.
+//----------------------------------------------------------------------
+void
+PriorityTest()
+{
+    DEBUG('t', "Entering PriorityTest");
+    ASSERT(N > 1 && T >= N && E > 0 && E < T);
+
+    char *data = new char[T];
+    int chunk = T / N;
+    int lane, got, i;
+    int errors = 0;
+
+    prioBuffer = new PriorityBuffer(T, N);
+    benchDone = new Semaphore("benchDone", 0);
+
+    // priority: every lane has data, so the most urgent is read first
+    for (lane = N - 1; lane >= 0; lane--) {
+        memset(data, lane, chunk);
+        prioBuffer->Write(lane, data, chunk);
+    }
+    for (i = 0; i < N; i++) {
+        got = prioBuffer->Read(data, T, &lane);
+        if (lane != i || got != chunk || data[0] != i || data[got - 1] != i) {
+            printf("*** read %d: %d bytes from lane %d ***\n", i, got, lane);
+            errors++;
+        }
+    }
+
+    // reserve: the bulk lane must leave E bytes for lane 0
+    prioBuffer->SetReserve(0, E);
+    prioBulkDone = 0;
+    prioControlDone = FALSE;
+    Thread *t = new Thread("priority bulk writer");
+    t->Fork(PriorityBulkWriter, N - 1);
+    for (i = 0; i < 100 * T && prioBulkDone < T - E; i++)
+        currentThread->Yield();
+    t = new Thread("priority control writer");
+    t->Fork(PriorityControlWriter, 0);
+    for (i = 0; i < 100; i++)
+        currentThread->Yield();
+    if (prioBulkDone != T - E || !prioControlDone) {
+        printf("*** bulk lane took %d bytes, control write %s ***\n",
+               prioBulkDone, prioControlDone ? "done" : "blocked");
+        errors++;
+    }
+
+    got = prioBuffer->Read(data, T, &lane);
+    if (lane != 0 || got != E) {
+        printf("*** first read: %d bytes from lane %d ***\n", got, lane);
+        errors++;
+    }
+    for (int done = 0; done < 2 * T; done += got) {
+        got = prioBuffer->Read(data, T, &lane);
+        if (lane != N - 1) {
+            printf("*** bulk read from lane %d ***\n", lane);
+            errors++;
+        }
+        for (i = 0; i < got; i++)
+            if (data[i] != StreamByte(done + i))
+                errors++;
+    }
+    benchDone->P();
+    benchDone->P();
+
+    printf("*** Priority: %d lanes, reserve %d of %d, %d wrong ***\n",
+           N, E, T, errors);
+    delete [] data;
+    delete benchDone;
+    delete prioBuffer;
+}
+
+//----------------------------------------------------------------------
+//VectorWriter, VectorReader
+//	Bodies of the VectorTest threads.  Each record is written with
+//  WriteV from three pieces (writer, sequence number and payload, all
+//  separate variables), and read with ReadV into two pieces split
+//  across a field.  A record must arrive whole, with the payload its
+//  writer and sequence number call for, and the records of any one
+//  writer must reach a reader in the order they were written.
+//----------------------------------------------------------------------
+#define VectorPayload 8
+struct VectorRecord {
+    int writer;
+    int seq;
+    char payload[VectorPayload];
+};
+static char *vectorSeen;
+
+static void
+VectorWriter(int w)
+{
+    char payload[VectorPayload];
+    int seq;
+    BufferSpan vec[3];
+
+    vec[0].data = (char *) &w;
+    vec[0].size = sizeof(int);
+    vec[1].data = (char *) &seq;
+    vec[1].size = sizeof(int);
+    vec[2].data = payload;
+    vec[2].size = VectorPayload;
+    for (seq = 0; seq < E; seq++) {
+        memset(payload, StreamByte(w + seq), VectorPayload);
+        buffer->WriteV(vec, 3);
+    }
+    benchDone->V();
+}
+
+static void
+VectorReader(int count)
+{
+    VectorRecord rec;
+    BufferSpan vec[2];
+    int *last = new int[N];		// last record seen from each writer
+
+    for (int w = 0; w < N; w++)
+        last[w] = -1;
+    vec[0].data = (char *) &rec;
+    vec[0].size = 6;
+    vec[1].data = (char *) &rec + 6;
+    vec[1].size = sizeof(rec) - 6;
+    for (int i = 0; i < count; i++) {
+        buffer->ReadV(vec, 2);
+        if (rec.writer < 0 || rec.writer >= N || rec.seq < 0 || rec.seq >= E
+            || rec.seq <= last[rec.writer]) {
+            streamErrors++;
+            continue;
+        }
+        for (int j = 0; j < VectorPayload; j++)
+            if (rec.payload[j] != StreamByte(rec.writer + rec.seq)) {
+                streamErrors++;
+                break;
+            }
+        last[rec.writer] = rec.seq;
+        vectorSeen[rec.writer * E + rec.seq]++;
+    }
+    delete [] last;
+    benchDone->V();
+}
+
+//----------------------------------------------------------------------
+//VectorTest
+//	Run N writers and N readers of VectorRecords over one buffer, and
+//  check that every record is delivered whole and exactly once.
+//  T:maxsize of boundedbuffer (at least one record)
+//  N:num of writer threads, and of reader threads
+//  E:num of records each writer writes
+//----------------------------------------------------------------------
+void
+VectorTest()
+{
+    DEBUG('t', "Entering VectorTest");
+    ASSERT(T >= (int) sizeof(VectorRecord) && N > 0 && E > 0);
+
+    buffer = new BoundedBuffer(T);
+    vectorSeen = new char[N * E];
+    memset(vectorSeen, 0, N * E);
+    benchDone = new Semaphore("benchDone", 0);
+    streamErrors = 0;
+    for (int i = 0; i < N; i++) {
+        Thread *t = new Thread("vector reader");
+        t->Fork(VectorReader, E);
+        t = new Thread("vector writer");
+        t->Fork(VectorWriter, i);
+    }
+    for (int i = 0; i < 2 * N; i++)
+        benchDone->P();
+
+    int missing = 0, repeated = 0;
+    for (int i = 0; i < N * E; i++) {
+        if (vectorSeen[i] == 0)
+            missing++;
+        else if (vectorSeen[i] > 1)
+            repeated++;
+    }
+    printf("*** Vector: %d records, %d missing, %d repeated, %d out of "
+           "order or bad ***\n", N * E, missing, repeated, streamErrors);
+    delete benchDone;
+    delete [] vectorSeen;
+    delete buffer;
+}
+
+//----------------------------------------------------------------------
+//SharedReader
+//	Body of the SharedTest child process: attach to the shared buffer
+//  'name', and read and check N bytes of the stream, in chunks of up
+//  to 64.  Exit with 0 if they were all right, 1 if not.
+//----------------------------------------------------------------------
+static void
+SharedReader(char *name)
+{
+    SharedBoundedBuffer *shared = SharedBoundedBuffer::Open(name, T);
+    char data[64];
+    int errors = 0;
+
+    if (shared == NULL)
+        _exit(1);
+
+    for (int done = 0; done < N; ) {
+        int n = 1 + Random() % 64;
+        if (n > N - done)
+            n = N - done;
+        shared->Read(data, n);
+        for (int i = 0; i < n; i++)
+            if (data[i] != StreamByte(done + i))
+                errors++;
+        done += n;
+    }
+    delete shared;
+    _exit(errors == 0 ? 0 : 1);
+}
+
+//----------------------------------------------------------------------
+//SharedTest
+//	Test SharedBoundedBuffer between two host processes.  A child
+//  process reads N bytes that this one writes through a buffer of T
+//  bytes; the two open the buffer at the same time, so either may be
+//  the one that creates it.  Then leave buffers behind as a creator
+//  that died before sizing, or before initializing, one would, and
+//  check that Open gives up on each and returns NULL rather than hang.
+//----------------------------------------------------------------------
+void
+SharedTest()
+{
+    DEBUG('t', "Entering SharedTest");
+    ASSERT(T > 0 && N > 0);
+
+    char name[32];
+    char *data = new char[N];
+    int status, fd;
+    pid_t pid;
+
+    sprintf(name, "/nachos-shared-%d", (int) getpid());
+    SharedBoundedBuffer::Unlink(name);	// in case a crashed run left it
+    for (int i = 0; i < N; i++)
+        data[i] = StreamByte(i);
+    fflush(stdout);
+    pid = fork();
+    ASSERT(pid >= 0);
+    if (pid == 0)
+        SharedReader(name);
+    SharedBoundedBuffer *shared = SharedBoundedBuffer::Open(name, T);
+    ASSERT(shared != NULL);
+    for (int done = 0; done < N; ) {
+        int n = 1 + Random() % 100;
+        if (n > N - done)
+            n = N - done;
+        shared->Write(data + done, n);
+        done += n;
+    }
+    waitpid(pid, &status, 0);
+    bool streamOk = WIFEXITED(status) && WEXITSTATUS(status) == 0;
+    delete shared;
+    SharedBoundedBuffer::Unlink(name);
+
+    bool staleOk = TRUE;
+    for (int size = 0; size <= 4096; size += 4096) {
+        fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+        ASSERT(fd >= 0);
+        if (size > 0) {                 // sized, but all zeros
+            int result = ftruncate(fd, size);
+            ASSERT(result == 0);
+        }
+        close(fd);
+        shared = SharedBoundedBuffer::Open(name, T);
+        if (shared != NULL) {
+            staleOk = FALSE;
+            delete shared;
+        }
+        SharedBoundedBuffer::Unlink(name);
+    }
+
+    printf("*** Shared: %d bytes through %d %s, stale buffer %s ***\n",
+           N, T, streamOk ? "ok" : "WRONG",
+           staleOk ? "refused" : "ACCEPTED");
+    delete [] data;
+}
+
+//----------------------------------------------------------------------
+//WatermarkVWriter, WatermarkVReader
+//	The plain Write and Read sides of WatermarkVTest: move 'size'
+//  bytes of the stream in one call.
+//----------------------------------------------------------------------
+static void
+WatermarkVWriter(int size)
+{
+    char *data = new char[size];
+
+    for (int i = 0; i < size; i++)
+        data[i] = StreamByte(i);
+    buffer->Write(data, size);
+    delete [] data;
+    benchDone->V();
+}
+
+static void
+WatermarkVReader(int size)
+{
+    char *data = new char[size];
+
+    buffer->Read(data, size);
+    for (int i = 0; i < size; i++)
+        if (data[i] != StreamByte(i))
+            streamErrors++;
+    delete [] data;
+    benchDone->V();
+}
+
+//----------------------------------------------------------------------
+//WatermarkVTest
+//	Mix ReadV and WriteV with a plain Write and Read that have a
+//  watermark as big as the buffer.  A 20 byte Write with a high
+//  watermark of 10 into a buffer of 10, against ReadVs of 3, 5, 5 and
+//  5 bytes, used to hang with 2 bytes in the buffer: the writer
+//  waiting for 10 free bytes, the reader for 5 bytes of data.  The
+//  mirror case is a Read with a low watermark of 10 against WriteVs.
+//  If either hangs, the test never prints its result.
+//----------------------------------------------------------------------
+void
+WatermarkVTest()
+{
+    DEBUG('t', "Entering WatermarkVTest");
+
+    static int sizes[] = { 3, 5, 5, 5, 2 };
+    char data[5];
+    BufferSpan span;
+    int done, i, j;
+
+    buffer = new BoundedBuffer(10);
+    benchDone = new Semaphore("benchDone", 0);
+    streamErrors = 0;
+
+    buffer->SetWatermarks(1, 10);
+    Thread *t = new Thread("watermark writer");
+    t->Fork(WatermarkVWriter, 20);
+    for (done = 0, i = 0; i < 5; done += sizes[i], i++) {
+        span.data = data;
+        span.size = sizes[i];
+        buffer->ReadV(&span, 1);
+        for (j = 0; j < sizes[i]; j++)
+            if (data[j] != StreamByte(done + j))
+                streamErrors++;
+    }
+    benchDone->P();
+    printf("*** ReadV against a high watermark: %d bytes, %d wrong ***\n",
+           done, streamErrors);
+
+    streamErrors = 0;
+    buffer->SetWatermarks(10, 1);
+    t = new Thread("watermark reader");
+    t->Fork(WatermarkVReader, 20);
+    for (done = 0, i = 0; i < 5; done += sizes[i], i++) {
+        for (j = 0; j < sizes[i]; j++)
+            data[j] = StreamByte(done + j);
+        span.data = data;
+        span.size = sizes[i];
+        buffer->WriteV(&span, 1);
+    }
+    benchDone->P();
+    printf("*** WriteV against a low watermark: %d bytes, %d wrong ***\n",
+           done, streamErrors);
+
+    delete benchDone;
+    delete buffer;
+}
+
+//----------------------------------------------------------------------
+//ResizeWriter, ResizeReadV, GrowReader
+//	Threads for ResizeTest.  ResizeWriter writes 'size' bytes of the
+//  stream in one Write; ResizeReadV reads and checks 'size' bytes of
+//  it in one ReadV; GrowReader reads and checks 'size' bytes one at a
+//  time, yielding after each, so that the writer keeps finding the
+//  buffer full but the reader never finds it empty.
+//----------------------------------------------------------------------
+static void
+ResizeWriter(int size)
+{
+    char *data = new char[size];
+
+    for (int i = 0; i < size; i++)
+        data[i] = StreamByte(i);
+    buffer->Write(data, size);
+    delete [] data;
+    benchDone->V();
+}
+
+static void
+ResizeReadV(int size)
+{
+    char *data = new char[size];
+    BufferSpan span;
+
+    span.data = data;
+    span.size = size;
+    buffer->ReadV(&span, 1);
+    for (int i = 0; i < size; i++)
+        if (data[i] != StreamByte(i))
+            streamErrors++;
+    delete [] data;
+    benchDone->V();
+}
+
+static void
+GrowReader(int size)
+{
+    char c;
+
+    for (int i = 0; i < size; i++) {
+        buffer->Read(&c, 1);
+        if (c != StreamByte(i))
+            streamErrors++;
+        currentThread->Yield();
+        currentThread->Yield();
+    }
+    benchDone->V();
+}
+
+//----------------------------------------------------------------------
+//ResizeCheck
+//	Count it as an error, and say so, if 'got' is not 'want'.
+//----------------------------------------------------------------------
+static void
+ResizeCheck(char *what, int got, int want)
+{
+    if (got != want) {
+        printf("*** %s: %d, not %d ***\n", what, got, want);
+        streamErrors++;
+    }
+}
+
+//----------------------------------------------------------------------
+//ResizeTest
+//	Test Resize and SetAutoGrow while threads are blocked.
+//
+//  A writer blocked on a full buffer of 8 must go on once it grows to
+//  32, and stop when that is full.  A reader blocked in a ReadV of 24
+//  on an empty buffer must keep Resize from shrinking it below 24,
+//  and get its data once written.  Then a buffer of 4 that may grow
+//  to 20 must do so, and no further, while a slow reader keeps it
+//  from ever being empty.
+//----------------------------------------------------------------------
+void
+ResizeTest()
+{
+    DEBUG('t', "Entering ResizeTest");
+
+    char data[100];
+    int i;
+
+    benchDone = new Semaphore("benchDone", 0);
+    streamErrors = 0;
+
+    // grow under a blocked writer
+    buffer = new BoundedBuffer(8);
+    Thread *t = new Thread("resize writer");
+    t->Fork(ResizeWriter, 40);
+    for (i = 0; i < 10; i++)
+        currentThread->Yield();
+    ResizeCheck("blocked writer wrote", buffer->Count(), 8);
+    ResizeCheck("grown to", buffer->Resize(32), 32);
+    for (i = 0; i < 10; i++)
+        currentThread->Yield();
+    ResizeCheck("blocked writer then wrote", buffer->Count(), 32);
+    buffer->Read(data, 40);
+    benchDone->P();
+    for (i = 0; i < 40; i++)
+        if (data[i] != StreamByte(i))
+            streamErrors++;
+
+    // shrink under a blocked ReadV
+    t = new Thread("resize reader");
+    t->Fork(ResizeReadV, 24);
+    for (i = 0; i < 10; i++)
+        currentThread->Yield();
+    ResizeCheck("shrunk to", buffer->Resize(4), 24);
+    for (i = 0; i < 24; i++)
+        data[i] = StreamByte(i);
+    buffer->Write(data, 24);
+    benchDone->P();
+    ResizeCheck("shrunk, once the ReadV was done, to", buffer->Resize(4), 4);
+    delete buffer;
+
+    // grow by itself, up to the limit
+    buffer = new BoundedBuffer(4);
+    buffer->SetAutoGrow(20);
+    t = new Thread("grow writer");
+    t->Fork(ResizeWriter, 100);
+    t = new Thread("grow reader");
+    t->Fork(GrowReader, 50);
+    benchDone->P();             // the reader, or the writer if it
+    for (i = 0; i < 10; i++)    // could not be stopped
+        currentThread->Yield();
+    ResizeCheck("grew to", buffer->Count(), 20);
+    buffer->Read(data, 50);
+    benchDone->P();
+    for (i = 0; i < 50; i++)
+        if (data[i] != StreamByte(50 + i))
+            streamErrors++;
+    delete buffer;
+
+    printf("*** Resize: %d wrong ***\n", streamErrors);
+    delete benchDone;
+}
+
+//----------------------------------------------------------------------
+//Tracked
+//	An element type for the template container tests that keeps
+//  count of the objects alive, and owns a heap copy of its value, so
+//  that a missing, extra or bitwise copy or destruction shows up as a
+//  wrong count, a wrong value or a double delete.
+//----------------------------------------------------------------------
+class Tracked {
+  public:
+    Tracked(int v = -1) { value = v; copy = new int(v); live++; }
+    Tracked(const Tracked &other)
+        { value = other.value; copy = new int(other.value); live++; }
+    Tracked &operator=(const Tracked &other)
+        { value = other.value; *copy = other.value; return *this; }
+    ~Tracked() { ASSERT(*copy == value); delete copy; live--; }
+
+    int value;
+    int *copy;		// always holds 'value'
+    static int live;	// objects constructed and not yet destroyed
+};
+int Tracked::live = 0;
+
+//----------------------------------------------------------------------
+//StaticWriter, StaticReader
+//	Bodies of the StaticBufferTest threads: write (read and check)
+//  Tracked objects 0, 1, 2, ... in batches of up to 5 (3).
+//----------------------------------------------------------------------
+static StaticBoundedBuffer<Tracked, 8> *staticBuffer;
+
+static void
+StaticWriter(int count)
+{
+    {
+        Tracked items[5];
+
+        for (int i = 0; i < count; ) {
+            int n = 1 + Random() % 5;
+            if (n > count - i)
+                n = count - i;
+            for (int j = 0; j < n; j++)
+                items[j] = Tracked(i + j);
+            staticBuffer->Write(items, n);
+            i += n;
+        }
+    }
+    benchDone->V();
+}
+
+static void
+StaticReader(int count)
+{
+    {
+        Tracked items[3];
+
+        for (int i = 0; i < count; ) {
+            int n = 1 + Random() % 3;
+            if (n > count - i)
+                n = count - i;
+            staticBuffer->Read(items, n);
+            for (int j = 0; j < n; j++)
+                if (items[j].value != i + j)
+                    streamErrors++;
+            i += n;
+        }
+    }
+    benchDone->V();
+}
+
+//----------------------------------------------------------------------
+//StaticBufferTest
+//	Pass 100 Tracked objects through a StaticBoundedBuffer of 8,
+//  reading only 95 of them, so that the buffer's destructor has to
+//  destroy the rest.  Every object constructed must then have been
+//  destroyed, exactly once.
+//----------------------------------------------------------------------
+void
+StaticBufferTest()
+{
+    DEBUG('t', "Entering StaticBufferTest");
+
+    benchDone = new Semaphore("benchDone", 0);
+    streamErrors = 0;
+    staticBuffer = new StaticBoundedBuffer<Tracked, 8>;
+    Thread *t = new Thread("static writer");
+    t->Fork(StaticWriter, 100);
+    t = new Thread("static reader");
+    t->Fork(StaticReader, 95);
+    benchDone->P();
+    benchDone->P();
+    int leftInBuffer = Tracked::live;
+    delete staticBuffer;
+    printf("*** StaticBoundedBuffer: %d wrong, %d left in the buffer, "
+           "%d alive after it ***\n", streamErrors, leftInBuffer,
+           Tracked::live);
+    delete benchDone;
+}
+
+//----------------------------------------------------------------------
+//CacheLine
+//	An element type for TypedTableTest that must start on a 64 byte
+//  boundary, more than new[] or a union of the common types promise.
+//----------------------------------------------------------------------
+struct CacheLine {
+    int value;
+} __attribute__((aligned(64)));
+
+//----------------------------------------------------------------------
+//TypedTableTest
+//	Fill a TypedTable of CacheLines, and check that every object is
+//  aligned and keeps its value.  Then put Tracked objects (see
+//  StaticBufferTest) in a TypedTable, release some, overwrite their
+//  slots, and delete the table with the rest still in it: every
+//  object the table constructed must be destroyed exactly once.
+//  Last, check that TypedTable<T *> hands back the very pointers.
+//----------------------------------------------------------------------
+void
+TypedTableTest()
+{
+    DEBUG('t', "Entering TypedTableTest");
+
+    int index[8];
+    int i, errors = 0, misaligned = 0;
+
+    TypedTable<CacheLine> *lines = new TypedTable<CacheLine>(8);
+    for (i = 0; i < 8; i++) {
+        CacheLine line;
+        line.value = 100 + i;
+        index[i] = lines->Alloc(line);
+    }
+    if (lines->Alloc(CacheLine()) != -1)
+        errors++;                       // the table was full
+    for (i = 0; i < 8; i++) {
+        CacheLine *line = lines->Get(index[i]);
+        if ((unsigned long) line % 64 != 0)
+            misaligned++;
+        if (line->value != 100 + i)
+            errors++;
+    }
+    delete lines;
+
+    int liveBefore = Tracked::live;
+    TypedTable<Tracked> *tracked = new TypedTable<Tracked>(8);
+    for (i = 0; i < 8; i++)
+        index[i] = tracked->Alloc(Tracked(i));
+    for (i = 0; i < 8; i += 2)
+        tracked->Release(index[i]);
+    for (i = 0; i < 8; i++)
+        if ((tracked->Get(index[i]) == NULL) != (i % 2 == 0)
+            || (i % 2 == 1 && tracked->Get(index[i])->value != i))
+            errors++;
+    for (i = 0; i < 8; i += 2)
+        index[i] = tracked->Alloc(Tracked(10 + i));
+    for (i = 0; i < 8; i += 2)
+        if (tracked->Get(index[i])->value != 10 + i)
+            errors++;
+    int liveIn = Tracked::live - liveBefore;
+    delete tracked;
+
+    TypedTable<int *> *pointers = new TypedTable<int *>(4);
+    int value = 42;
+    if (pointers->Get(pointers->Alloc(&value)) != &value)
+        errors++;
+    delete pointers;
+
+    printf("*** TypedTable: %d wrong, %d misaligned, %d objects in the "
+           "table, %d alive after it ***\n", errors, misaligned, liveIn,
+           Tracked::live - liveBefore);
+}
+
+//----------------------------------------------------------------------
+//ZeroCopyWriter, ZeroCopyReader
+//	Bodies of the ZeroCopyTest threads: send (receive and check)
+//  'total' bytes of the stream through WriteReserve and WriteCommit
+//  (ReadPeek and ReadConsume), filling (using) only part of each
+//  reservation (peek) now and then, and yielding at random so the
+//  ends of the ring do not move in lockstep.  Count the reservations
+//  and peeks that wrapped around the end of the ring.
+//----------------------------------------------------------------------
+static int zeroCopyWraps;
+
+static void
+ZeroCopyWriter(int total)
+{
+    BufferSpan span[2];
+
+    for (int done = 0; done < total; ) {
+        int n = buffer->WriteReserve(1 + Random() % 8, span);
+        if (span[1].size > 0)
+            zeroCopyWraps++;
+        if (n > total - done)
+            n = total - done;
+        if (n > 1 && Random() % 4 == 0)
+            n--;                        // commit less than we got
+        for (int i = 0; i < n; i++) {
+            BufferSpan *s = (i < span[0].size) ? &span[0] : &span[1];
+            int at = (i < span[0].size) ? i : i - span[0].size;
+            s->data[at] = StreamByte(done + i);
+        }
+        buffer->WriteCommit(n);
+        done += n;
+        for (int j = Random() % 3; j > 0; j--)
+            currentThread->Yield();
+    }
+    benchDone->V();
+}
+
+static void
+ZeroCopyReader(int total)
+{
+    BufferSpan span[2];
+
+    for (int done = 0; done < total; ) {
+        int n = buffer->ReadPeek(1 + Random() % 8, span);
+        if (span[1].size > 0)
+            zeroCopyWraps++;
+        if (n > 1 && Random() % 4 == 0)
+            n--;                        // consume less than we saw
+        for (int i = 0; i < n; i++) {
+            char c = (i < span[0].size) ? span[0].data[i]
+                                        : span[1].data[i - span[0].size];
+            if (c != StreamByte(done + i))
+                streamErrors++;
+        }
+        buffer->ReadConsume(n);
+        done += n;
+        for (int j = Random() % 3; j > 0; j--)
+            currentThread->Yield();
+    }
+    benchDone->V();
+}
+
+//----------------------------------------------------------------------
+//ZeroCopyTest
+//	Test the zero-copy calls where the space or data wraps around the
+//  end of the ring.  First, by hand: with 'in' and 'out' at 7 in a
+//  buffer of 10, an 8 byte reservation and an 8 byte peek must each
+//  come as 3 bytes at the end and 5 at the start.  Then stream bytes
+//  between a zero-copy writer and reader through a buffer of 7, and
+//  check that they arrive intact and that some spans did wrap.
+//----------------------------------------------------------------------
+void
+ZeroCopyTest()
+{
+    DEBUG('t', "Entering ZeroCopyTest");
+
+    BufferSpan span[2];
+    char data[10];
+    int i, n, errors = 0;
+
+    buffer = new BoundedBuffer(10);
+    buffer->Write(data, 7);
+    buffer->Read(data, 7);
+    n = buffer->WriteReserve(8, span);
+    if (n != 8 || span[0].size != 3 || span[1].size != 5
+        || span[1].data + 7 != span[0].data)
+        errors++;
+    for (i = 0; i < 3; i++)
+        span[0].data[i] = StreamByte(i);
+    for (i = 0; i < 5; i++)
+        span[1].data[i] = StreamByte(3 + i);
+    buffer->WriteCommit(8);
+    n = buffer->ReadPeek(8, span);
+    if (n != 8 || span[0].size != 3 || span[1].size != 5)
+        errors++;
+    else
+        for (i = 0; i < 8; i++)
+            if ((i < 3 ? span[0].data[i] : span[1].data[i - 3])
+                != StreamByte(i))
+                errors++;
+    buffer->ReadConsume(5);             // leave 3 behind
+    if (buffer->Count() != 3)
+        errors++;
+    buffer->Read(data, 3);
+    for (i = 0; i < 3; i++)
+        if (data[i] != StreamByte(5 + i))
+            errors++;
+    delete buffer;
+
+    buffer = new BoundedBuffer(7);
+    benchDone = new Semaphore("benchDone", 0);
+    streamErrors = 0;
+    zeroCopyWraps = 0;
+    Thread *t = new Thread("zero-copy writer");
+    t->Fork(ZeroCopyWriter, 2000);
+    t = new Thread("zero-copy reader");
+    t->Fork(ZeroCopyReader, 2000);
+    benchDone->P();
+    benchDone->P();
+    printf("*** ZeroCopy: %d wrong by hand, %d wrong in 2000 bytes, "
+           "%d wrapped spans ***\n", errors, streamErrors, zeroCopyWraps);
+    delete benchDone;
+    delete buffer;
+}
+
+//----------------------------------------------------------------------
+//PartialWriter, PartialReader
+//	Helpers for PartialTest: once the main thread is waiting, write
+//  (read) 'size' bytes of the stream, fewer than it asked for.
+//----------------------------------------------------------------------
+static void
+PartialWriter(int size)
+{
+    char data[8];
+
+    for (int i = 0; i < size; i++)
+        data[i] = StreamByte(i);
+    buffer->Write(data, size);
+}
+
+static void
+PartialReader(int size)
+{
+    char data[8];
+
+    buffer->Read(data, size);
+}
+
+//----------------------------------------------------------------------
+//PartialTest
+//	Test the calls that may move less than asked for.  TryRead and
+//  TryWrite return 0 on an empty or full buffer, and while a zero-copy
+//  peek or reservation is outstanding, and otherwise move what there
+//  is.  ReadSome and WriteSome wait for some data or room, then return
+//  with only what there was, even if that is less than 'size'.
+//----------------------------------------------------------------------
+void
+PartialTest()
+{
+    DEBUG('t', "Entering PartialTest");
+
+    BufferSpan span[2];
+    char data[16];
+    int i, errors = 0;
+
+    for (i = 0; i < 16; i++)
+        data[i] = StreamByte(i);
+    buffer = new BoundedBuffer(8);
+
+    if (buffer->TryRead(data, 4) != 0)                  // empty
+        errors++;
+    if (buffer->TryWrite(data, 5) != 5)
+        errors++;
+    if (buffer->TryWrite(data + 5, 5) != 3)             // room for 3
+        errors++;
+    if (buffer->TryWrite(data, 1) != 0)                 // full
+        errors++;
+    if (buffer->TryRead(data, 16) != 8)
+        errors++;
+    for (i = 0; i < 8; i++)
+        if (data[i] != StreamByte(i))
+            errors++;
+
+    buffer->WriteReserve(4, span);                      // reserved
+    if (buffer->TryWrite(data, 4) != 0)
+        errors++;
+    buffer->WriteCommit(4);
+    buffer->ReadPeek(4, span);                          // peeked
+    if (buffer->TryRead(data, 4) != 0)
+        errors++;
+    buffer->ReadConsume(4);
+
+    buffer->Write(data, 3);
+    if (buffer->ReadSome(data, 8) != 3)                 // 3 there
+        errors++;
+    buffer->Write(data, 6);
+    if (buffer->WriteSome(data, 6) != 2)                // room for 2
+        errors++;
+    buffer->Read(data, 8);
+
+    Thread *t = new Thread("partial writer");
+    t->Fork(PartialWriter, 2);
+    if (buffer->ReadSome(data, 8) != 2)                 // waits for 2
+        errors++;
+    for (i = 0; i < 2; i++)
+        if (data[i] != StreamByte(i))
+            errors++;
+    buffer->Write(data, 8);
+    t = new Thread("partial reader");
+    t->Fork(PartialReader, 3);
+    if (buffer->WriteSome(data, 8) != 3)                // waits for 3
+        errors++;
+    if (buffer->Count() != 8)
+        errors++;
+
+    printf("*** Partial: %d wrong ***\n", errors);
+    delete buffer;
+}
+
+//----------------------------------------------------------------------
+//TrickleWriter, TrickleReader
+//	Bodies of the WatermarkWaitsTest threads.  The writer sends
+//  'total' bytes of the stream one at a time and yields after each, so
+//  data trickles in; the reader asks for 32 bytes at a time and checks
+//  what it gets.
+//----------------------------------------------------------------------
+static void
+TrickleWriter(int total)
+{
+    for (int i = 0; i < total; i++) {
+        char c = StreamByte(i);
+        buffer->Write(&c, 1);
+        currentThread->Yield();
+    }
+    benchDone->V();
+}
+
+static void
+TrickleReader(int total)
+{
+    char data[32];
+
+    for (int done = 0; done < total; done += 32) {
+        buffer->Read(data, 32);
+        for (int i = 0; i < 32; i++)
+            if (data[i] != StreamByte(done + i))
+                streamErrors++;
+    }
+    benchDone->V();
+}
+
+//----------------------------------------------------------------------
+//TrickleWaits
+//	Trickle 640 bytes through a buffer of 16 with the given
+//  watermarks, and return how many times a thread waited.
+//----------------------------------------------------------------------
+static int
+TrickleWaits(int low, int high)
+{
+    int waits;
+
+    buffer = new BoundedBuffer(16);
+    buffer->SetWatermarks(low, high);
+    Thread *t = new Thread("trickle writer");
+    t->Fork(TrickleWriter, 640);
+    t = new Thread("trickle reader");
+    t->Fork(TrickleReader, 640);
+    benchDone->P();
+    benchDone->P();
+    waits = buffer->Waits();
+    delete buffer;
+    return waits;
+}
+
+//----------------------------------------------------------------------
+//WatermarkWaitsTest
+//	Check that watermarks cut the number of waits.  With the default
+//  of 1 a reader is woken for every byte that trickles in and waits
+//  again for the next; with a low watermark of 8 it is woken once per
+//  8 bytes, so there should be several times fewer waits.  Watermarks
+//  mixed with ReadV and WriteV are tested in WatermarkVTest.
+//----------------------------------------------------------------------
+void
+WatermarkWaitsTest()
+{
+    DEBUG('t', "Entering WatermarkWaitsTest");
+
+    benchDone = new Semaphore("benchDone", 0);
+    streamErrors = 0;
+    int plain = TrickleWaits(1, 1);
+    int marked = TrickleWaits(8, 8);
+    printf("*** Watermarks: %d waits at 1/1, %d at 8/8, %s; "
+           "%d wrong ***\n", plain, marked,
+           (marked * 4 <= plain) ? "fewer" : "NOT fewer", streamErrors);
+    delete benchDone;
+}
+
+//----------------------------------------------------------------------
+//WaitTicks
+//	Let at least 'ticks' ticks of simulated time pass.
+//----------------------------------------------------------------------
+static void
+WaitTicks(int ticks)
+{
+    int until = stats->totalTicks + ticks;
+
+    while (stats->totalTicks < until)
+        currentThread->Yield();
+}
+
+//----------------------------------------------------------------------
+//LatencyTest
+//	Check the latency histogram against a known schedule.  Of 100
+//  bytes, 98 are read as soon as they are written, and 2 only after
+//  1000 ticks.  So the count must be 100, p50 must be small, and p99,
+//  which has to take in the 99th byte, must be at least 1000 ticks
+//  (a few more for the calls themselves) but below 2048.
+//----------------------------------------------------------------------
+void
+LatencyTest()
+{
+    DEBUG('t', "Entering LatencyTest");
+
+    char data[100];
+    int errors = 0;
+
+    buffer = new BoundedBuffer(100);
+    buffer->TrackLatency(TRUE);
+    if (buffer->LatencyCount() != 0)
+        errors++;
+    for (int i = 0; i < 98; i++) {
+        buffer->Write(data, 1);
+        buffer->Read(data, 1);
+    }
+    buffer->Write(data, 2);
+    WaitTicks(1000);
+    buffer->Read(data, 2);
+
+    int count = buffer->LatencyCount();
+    int p50 = buffer->LatencyPercentile(50);
+    int p99 = buffer->LatencyPercentile(99);
+    if (count != 100 || p50 >= 100 || p99 < 1000 || p99 >= 2048)
+        errors++;
+    printf("*** Latency: %d bytes, p50 <= %d, p99 <= %d ticks, "
+           "%d wrong ***\n", count, p50, p99, errors);
+    buffer->PrintLatency();
+    delete buffer;
+}
+
+//----------------------------------------------------------------------
+//TableStatsThread
+//	Body of the TableStatsTest threads: allocate and release a slot
+//  'which' + 1 times each, yielding between (but never inside) the
+//  calls so the threads interleave.
+//----------------------------------------------------------------------
+static void
+TableStatsThread(int which)
+{
+    for (int i = 0; i <= which; i++) {
+        int index = table->Alloc((void *)(which + 1));
+        currentThread->Yield();
+        if (index != -1)
+            table->Release(index);
+        currentThread->Yield();
+    }
+    benchDone->V();
+}
+
+//----------------------------------------------------------------------
+//TableStatsTest
+//	Check the Alloc statistics.  A NULL object and a full table both
+//  count as failures.  Alloc only counts a lock wait when it sleeps
+//  for the lock, so threads that never meet inside Alloc must record
+//  no waits and no ticks, however many ticks their calls take.  (With
+//  -rs a thread may be switched out holding the lock; then the others
+//  wait, and each wait must cost some ticks.)
+//----------------------------------------------------------------------
+void
+TableStatsTest()
+{
+    DEBUG('t', "Entering TableStatsTest");
+
+    int i, errors = 0;
+
+    table = new Table(4);
+    if (table->Alloc(NULL) != -1)
+        errors++;
+    for (i = 0; i < 4; i++)
+        if (table->Alloc((void *)(i + 1)) != i)
+            errors++;
+    if (table->Alloc((void *)5) != -1)                  // full
+        errors++;
+    if (table->Failures() != 2)
+        errors++;
+    for (i = 0; i < 4; i++)
+        table->Release(i);
+
+    benchDone = new Semaphore("benchDone", 0);
+    for (i = 0; i < 4; i++) {
+        Thread *t = new Thread("table stats thread");
+        t->Fork(TableStatsThread, i);
+    }
+    for (i = 0; i < 4; i++)
+        benchDone->P();
+    if (table->LockWaits() == 0 ? table->LockWaitTicks() != 0
+                                : table->LockWaitTicks() <= 0)
+        errors++;
+    printf("*** TableStats: %d failures, %d lock waits, %d ticks, "
+           "%d wrong ***\n", table->Failures(), table->LockWaits(),
+           table->LockWaitTicks(), errors);
+    table->PrintStats();
+    delete benchDone;
+    delete table;
+}
+
+//----------------------------------------------------------------------
+//TableChurnTest
+//	Churn a Table with a reverse index through random Alloc, Release
+//  and Find calls, and check every result against a plain array of
+//  what each slot should hold.  Alloc must take a free slot, and fail
+//  only when none is free; Find must return the slot of every object
+//  in the table and -1 for every object released.  Now and then a
+//  reader is kept inside BeginRead/EndRead for a while, and the slots
+//  released meanwhile must not be handed out again until it leaves.
+//  It enters just after an Alloc, which makes every slot released
+//  before then reusable, so those are fair game.
+//----------------------------------------------------------------------
+#define ChurnSize 16
+
+void
+TableChurnTest()
+{
+    DEBUG('t', "Entering TableChurnTest");
+
+    void *expect[ChurnSize];            // what each slot should hold
+    bool pinned[ChurnSize];             // released under the reader
+    int i, errors = 0, next = 1, readEpoch = -1;
+    bool enter = FALSE;                 // a reader enters after Alloc
+
+    table = new Table(ChurnSize, TRUE);
+    for (i = 0; i < ChurnSize; i++) {
+        expect[i] = NULL;
+        pinned[i] = FALSE;
+    }
+    for (int step = 0; step < 5000; step++) {
+        int free = 0;
+        for (i = 0; i < ChurnSize; i++)
+            if (expect[i] == NULL && !pinned[i])
+                free++;
+
+        switch (Random() % 4) {
+          case 0:
+          case 1: {                     // Alloc a new object
+            void *object = (void *)(8 * next++);
+            int index = table->Alloc(object);
+            if (index == -1 ? free > 0
+                            : expect[index] != NULL || pinned[index])
+                errors++;
+            if (index != -1)
+                expect[index] = object;
+            if (enter) {                // all releases so far are old
+                readEpoch = table->BeginRead();
+                enter = FALSE;
+            }
+            break;
+          }
+          case 2:                       // Release a random slot in use
+            i = Random() % ChurnSize;
+            if (expect[i] != NULL) {
+                table->Release(i);
+                if (table->Find(expect[i]) != -1)
+                    errors++;
+                expect[i] = NULL;
+                pinned[i] = (readEpoch != -1);
+            }
+            break;
+          case 3: {                     // Find any object so far
+            void *object = (void *)(8 * (1 + Random() % next));
+            int index = -1;
+            for (i = 0; i < ChurnSize; i++)
+                if (expect[i] == object)
+                    index = i;
+            if (table->Find(object) != index)
+                errors++;
+            break;
+          }
+        }
+        if (step % 100 == 0 && readEpoch != -1) {       // reader leaves
+            table->EndRead(readEpoch);
+            readEpoch = -1;
+            for (i = 0; i < ChurnSize; i++)
+                pinned[i] = FALSE;
+        } else if (step % 100 == 50 && readEpoch == -1)
+            enter = TRUE;
+        for (i = 0; i < ChurnSize; i++)
+            if (table->Get(i) != expect[i])
+                errors++;
+    }
+    if (readEpoch != -1)
+        table->EndRead(readEpoch);
+    printf("*** TableChurn: %d objects through %d slots, %d wrong ***\n",
+           next - 1, ChurnSize, errors);
+    delete table;
+}
+
+//----------------------------------------------------------------------
+//SignalConsumer
+//	Body of the SignalBenchmark consumers: take 'ops' items, waiting
+//  for each until there is one.  With 'signalSem' set, wait the way
+//  Condition::Wait did before signalled waiters were moved onto the
+//  lock's queue: release the lock, sleep until woken, and then
+//  acquire the lock again, like any other thread.  Otherwise use
+//  'signalCond'.
+//----------------------------------------------------------------------
+static Condition *signalCond;
+static Semaphore *signalSem;
+static int signalItems, signalWaiters;
+
+static void
+SignalConsumer(int ops)
+{
+    for (int i = 0; i < ops; i++) {
+        benchLock->Acquire();
+        while (signalItems == 0) {
+            if (signalSem != NULL) {
+                signalWaiters++;
+                benchLock->Release();
+                signalSem->P();
+                benchLock->Acquire();
+            } else
+                signalCond->Wait(benchLock);
+        }
+        signalItems--;
+        benchLock->Release();
+    }
+    benchDone->V();
+}
+
+//----------------------------------------------------------------------
+//SignalBenchmark
+//	Count how often the lock is slept on when a thread signals a
+//  condition while holding the lock, and yields before releasing it.
+//  A waiter that is simply woken runs first, finds the lock taken, and
+//  sleeps again on the lock; one moved onto the lock's queue by Signal
+//  sleeps only once, and is woken by Release.  Run 4 consumers for
+//  2000 items, first with Condition, then with a condition built from
+//  a semaphore that only wakes the waiter, as Signal used to do.  The
+//  lock hands off, so that the signaller never takes it back before a
+//  woken thread runs; that would cost wasted wakeups in both runs.
+//----------------------------------------------------------------------
+void
+SignalBenchmark()
+{
+    DEBUG('t', "Entering SignalBenchmark");
+
+    benchDone = new Semaphore("benchDone", 0);
+    for (int run = 0; run < 2; run++) {
+        benchLock = new Lock("signal lock", TRUE);
+        signalCond = NULL;
+        signalSem = NULL;
+        if (run == 0)
+            signalCond = new Condition("signal cond");
+        else
+            signalSem = new Semaphore("signal sem", 0);
+        signalItems = signalWaiters = 0;
+        for (int i = 0; i < 4; i++) {
+            Thread *t = new Thread("signal consumer");
+            t->Fork(SignalConsumer, 500);
+        }
+        for (int i = 0; i < 2000; i++) {
+            benchLock->Acquire();
+            signalItems++;
+            if (signalCond != NULL)
+                signalCond->Signal(benchLock);
+            else if (signalWaiters > 0) {
+                signalWaiters--;
+                signalSem->V();
+            }
+            currentThread->Yield();     // still holding the lock
+            benchLock->Release();
+            if (i % 4 == 0)
+                currentThread->Yield();
+        }
+        for (int i = 0; i < 4; i++)
+            benchDone->P();
+
+        printf("%-9s: %5d lock acquires, %5d lock sleeps, "
+               "%5d wasted wakeups\n", run == 0 ? "Condition" : "wake-only",
+               benchLock->Acquires(), benchLock->Sleeps(),
+               benchLock->Requeues());
+        delete signalCond;
+        delete signalSem;
+        delete benchLock;
+    }
+    benchLock = NULL;
+    delete benchDone;
+}
+
+//----------------------------------------------------------------------
+// ThreadTest
+// 	Invoke a test routine.
+//----------------------------------------------------------------------
+
+void
+ThreadTest(int t, int n, int e)
+{
+    switch (testnum) {
+    case 1:
+        ThreadTest1();
+        break;
+    case 2:
+        T = t;
+        N = n;
+        E = e;
+        ThreadTest2();
+        break;
+    // test Lock and Condition
+    case 3:
+        ThreadTest3();
+        break;
+    case 4:
+        T = t;
+        N = n;
+        TableTest();
+        break;
+    case 6:
+        T = t;
+        N = n;
+        E = e;
+        BufferTest();
+        break;
+    case 10:
+        T = t;
+        N = n;
+        E = e;
+        BufferBenchmark();
+        break;
+    case 11:
+        T = t;
+        N = n;
+        E = e;
+        PipelineTest();
+        break;
+    case 12:
+        T = t;
+        N = n;
+        LockBenchmark();
+        break;
+    case 13:
+        T = t;
+        N = n;
+        E = e;
+        RWLockTest();
+        break;
+    case 14:
+        T = t;
+        N = n;
+        AdaptiveLockBenchmark();
+        break;
+    case 15:
+        T = t;
+        N = n;
+        E = e;
+        SPSCTest();
+        break;
+    case 16:
+        T = t;
+        N = n;
+        E = e;
+        MPMCTest();
+        break;
+    case 17:
+        T = t;
+        N = n;
+        E = e;
+        BroadcastTest();
+        break;
+    case 18:
+        T = t;
+        N = n;
+        E = e;
+        PriorityTest();
+        break;
+    case 19:
+        T = t;
+        N = n;
+        E = e;
+        VectorTest();
+        break;
+    case 20:
+        T = t;
+        N = n;
+        SharedTest();
+        break;
+    case 21:
+        WatermarkVTest();
+        break;
+    case 22:
+        ResizeTest();
+        break;
+    case 23:
+        StaticBufferTest();
+        break;
+    case 24:
+        TypedTableTest();
+        break;
+    case 25:
+        ZeroCopyTest();
+        break;
+    case 26:
+        PartialTest();
+        break;
+    case 27:
+        WatermarkWaitsTest();
+        break;
+    case 28:
+        LatencyTest();
+        break;
+    case 29:
+        TableStatsTest();
+        break;
+    case 30:
+        TableChurnTest();
+        break;
+    case 31:
+        SignalBenchmark();
         break;
     default:
         printf("No test specified.\n");
@@ -1,5 +1,14 @@
 #include "system.h"
 //#define OUTPUT
+
+// A pending call made by SetTimeout.
+struct Timeout
+{
+    int id; // never reused while the timeout may be pending
+    VoidFunctionPtr handler;
+    int arg;
+};
+
 //----------------------------------------------------------------------
 // Alarm::Alarm
 //	Initialize an alarm with a waiting list.
@@ -7,6 +16,9 @@
 Alarm::Alarm()
 {
     list = new List();
+    timeouts = new List();
+    num = 0;
+    lastTimeoutId = 0;
 }
 
 //----------------------------------------------------------------------
@@ -16,6 +28,7 @@ Alarm::Alarm()
 Alarm::~Alarm()
 {
     delete list;
+    delete timeouts;
 }
 
 //----------------------------------------------------------------------
@@ -107,5 +120,89 @@ Alarm::Wakeup()
         }
     }
 
+    // likewise for timeouts; the handlers run with interrupts off
+    Timeout *timeout = (Timeout *)timeouts->SortedRemove(&waketime);
+    while (timeout != NULL)
+    {
+        if (waketime <= stats->totalTicks)
+        {
+            (*timeout->handler)(timeout->arg);
+            delete timeout;
+            num--;
+            timeout = (Timeout *)timeouts->SortedRemove(&waketime);
+        }
+        else
+        {
+            timeouts->SortedInsert((void *)timeout, waketime);
+            break;
+        }
+    }
+
     (void)interrupt->SetLevel(oldLevel); // enable interrupts
 }
+
+//----------------------------------------------------------------------
+// Alarm::SetTimeout
+//	Arrange for handler(arg) to be called once 'ticks' ticks have
+//  passed (unlike Pause, this counts ticks, not timer intervals).  It
+//  is called from Wakeup, i.e. from the timer interrupt, so it must not
+//  block; V on a semaphore is fine.  The calling thread carries on.
+//  Return an id to pass to CancelTimeout.  The Timeout itself is freed
+//  when it fires, and its address may then be handed to a new one, so
+//  callers only get the id, which is not reused (until 2^31 timeouts
+//  later) and so cannot cancel someone else's timeout by mistake.
+//----------------------------------------------------------------------
+int
+Alarm::SetTimeout(int ticks, VoidFunctionPtr handler, int arg)
+{
+    IntStatus oldLevel = interrupt->SetLevel(IntOff);
+
+    Timeout *timeout = new Timeout;
+    if (lastTimeoutId == 0x7fffffff)
+        lastTimeoutId = 0;
+    timeout->id = ++lastTimeoutId;
+    timeout->handler = handler;
+    timeout->arg = arg;
+    timeouts->SortedInsert((void *)timeout, stats->totalTicks + ticks);
+    num++;
+
+    // as in Pause, make sure someone keeps checking the lists
+    if (num == 1)
+    {
+        Thread *t = new Thread("CheckList thread");
+        t->Fork(CheckHandler, (int)this);
+    }
+    (void)interrupt->SetLevel(oldLevel);
+    return timeout->id;
+}
+
+//----------------------------------------------------------------------
+// Alarm::CancelTimeout
+//	Remove the timeout with this id, if it has not fired yet.
+//  Since the handler only runs with interrupts off, once this returns
+//  it is guaranteed not to run.  The list has no way to remove an item
+//  from the middle, so take the items off and put back all the others.
+//----------------------------------------------------------------------
+void
+Alarm::CancelTimeout(int id)
+{
+    IntStatus oldLevel = interrupt->SetLevel(IntOff);
+
+    List *rest = new List();
+    int waketime;
+    Timeout *timeout;
+    while ((timeout = (Timeout *)timeouts->SortedRemove(&waketime)) != NULL)
+    {
+        if (timeout->id == id)
+        {
+            delete timeout;
+            num--;
+        }
+        else
+            rest->SortedInsert((void *)timeout, waketime);
+    }
+    delete timeouts;
+    timeouts = rest;
+
+    (void)interrupt->SetLevel(oldLevel);
+}
@@ -1,4 +1,8 @@
+#ifndef ALARM_H
+#define ALARM_H
+
 #include "list.h"
+#include "utility.h"
 
 class Alarm
 {
@@ -9,7 +13,16 @@ public:
     void Wakeup();
     void CheckList();
 
+    // call handler(arg) once 'ticks' ticks from now, from the timer
+    // interrupt, unless cancelled first; return an id for CancelTimeout
+    int SetTimeout(int ticks, VoidFunctionPtr handler, int arg);
+    void CancelTimeout(int id); // no-op if it has already fired
+
 private:
     List *list; // waiting list
-    int num; // num of threads in waiting list
+    List *timeouts; // pending timeouts, sorted by expiry time
+    int num; // num of threads in waiting list, plus pending timeouts
+    int lastTimeoutId; // id given to the latest timeout
 };
+
+#endif // ALARM_H
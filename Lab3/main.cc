@@ -111,7 +111,7 @@ main(int argc, char **argv)
 			RandomInit(unsigned(T * T + N * N));	// initialize pseudo-random
 			argCount += 3;
 		}
-		if (testnum == 4) {
+		if (testnum == 4 or testnum == 10) {
 			if (argc < 4) {
 				printf("too few parameters\n");
 				break;
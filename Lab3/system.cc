@@ -7,6 +7,7 @@
 
 #include "copyright.h"
 #include "system.h"
+#include "Table.h"
 
 // This defines *all* of the global data structures used by Nachos.
 // These are all initialized and de-allocated by this file.
@@ -175,6 +176,8 @@ void
 Cleanup()
 {
     printf("\nCleaning up...\n");
+    if (DebugIsEnabled('T'))			// Table occupancy and contention
+	Table::PrintAllStats();
 #ifdef NETWORK
     delete postOffice;
 #endif
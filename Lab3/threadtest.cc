@@ -17,11 +17,7 @@
 #include "BoundedBuffer.h"
 #include "EventBarrier.h"
 #include "Elevator.h"
-<<<<<<< HEAD
 #define STOP_TIME 1000000
-=======
-#define STOP_TIME 800000
->>>>>>> 7a95b12f52005db4f4e1ab4f6c13ba450bd42216
 
 extern void GenerateN(int N, DLList *list);
 extern void RemoveN(int N, DLList *list);
@@ -590,6 +586,93 @@ AlarmTest(int t)
     }
 }
 
+//----------------------------------------------------------------------
+// TimeoutCheck
+//  Report whether a timed Read or Write moved the expected number of
+//  bytes and, if it was to time out, waited out its ticks first.
+//----------------------------------------------------------------------
+static int timeoutErrors;
+
+static void
+TimeoutCheck(char *what, int got, int want, int start, int ticks)
+{
+    int waited = stats->totalTicks - start;
+    bool ok = got == want && (ticks < 0 || waited >= ticks);
+
+    printf("*** %s: %d bytes (want %d) after %d ticks%s ***\n",
+           what, got, want, waited, ok ? "" : " WRONG");
+    if (!ok)
+        timeoutErrors++;
+}
+
+//----------------------------------------------------------------------
+// TimeoutWriter
+//  Write to the buffer after a short Pause, to wake a timed reader
+//  well before its deadline.
+//----------------------------------------------------------------------
+static void
+TimeoutWriter(int size)
+{
+    char *data = new char[size];
+
+    alarms->Pause(1);
+    buffer->Write(data, size);
+    delete [] data;
+}
+
+//----------------------------------------------------------------------
+// TimeoutTest
+//  A test routine for BoundedBuffer::ReadTimeout and WriteTimeout.
+//  T is the size of the buffer, N the ticks each call may wait.  Timed
+//  calls on an empty or full buffer must move nothing, and on a half
+//  full or half empty one only the half, and only after waiting N
+//  ticks; a timed reader must be woken as soon as the data comes.
+//----------------------------------------------------------------------
+void
+TimeoutTest()
+{
+    DEBUG('t', "Entering TimeoutTest");
+    ASSERT(T > 1 && N > 0);
+
+    char *data = new char[T];
+    int half = T / 2;
+    int start;
+    buffer = new BoundedBuffer(T);
+    timeoutErrors = 0;
+
+    start = stats->totalTicks;
+    TimeoutCheck("read empty", buffer->ReadTimeout(data, T, N), 0, start, N);
+
+    buffer->Write(data, half);
+    start = stats->totalTicks;
+    TimeoutCheck("read half full", buffer->ReadTimeout(data, T, N),
+                 half, start, N);
+
+    buffer->Write(data, T);
+    start = stats->totalTicks;
+    TimeoutCheck("write full", buffer->WriteTimeout(data, T, N), 0, start, N);
+
+    buffer->Read(data, half);
+    start = stats->totalTicks;
+    TimeoutCheck("write half empty", buffer->WriteTimeout(data, T, N),
+                 half, start, N);
+    buffer->Read(data, T);
+
+    Thread *t = new Thread("timeout writer");
+    t->Fork(TimeoutWriter, half);
+    start = stats->totalTicks;
+    int got = buffer->ReadTimeout(data, half, 1000 * TimerTicks + N);
+    TimeoutCheck("read woken early", got, half, start, -1);
+    if (stats->totalTicks - start >= 1000 * TimerTicks + N) {
+        printf("*** read woken early: woke only at its deadline ***\n");
+        timeoutErrors++;
+    }
+
+    printf("*** TimeoutTest: %d wrong ***\n", timeoutErrors);
+    delete buffer;
+    delete [] data;
+}
+
 
 
 
@@ -827,6 +910,11 @@ ThreadTest(int t, int n, int e)
     case 9:
         ElevatorTest(t,n,e);
         break;
+    case 10:
+        T = t;
+        N = n;
+        TimeoutTest();
+        break;
     default:
         printf("No test specified.\n");
         break;